@@ -4,140 +4,196 @@
 
 #include "buffer.h"
 
-// Buffer1f
-Buffer1f::Buffer1f(int w, int h, InitType type) : Buffer(w, h)
+#include <algorithm>
+#include <cmath>
+
+// Half Floats (round to nearest even, denormals & infinities are kept)
+uint16_t PixelFormat::FloatToHalf(float value)
 {
-    if (type == Zero)
-        m_Data = std::vector<Data>(w * h, Data(0.f));
-    else if (type == One)
-        m_Data = std::vector<Data>(w * h, Data(1.f));
-    else if (type == MaxPositive)
-        m_Data = std::vector<Data>(w * h, Data(MaxFloat));
-    else if (type == MinNegative)
-        m_Data = std::vector<Data>(w * h, Data(MinFloat));
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint16_t sign = (uint16_t)((bits >> 16) & 0x8000u);
+    uint32_t magnitude = bits & 0x7fffffffu;
+
+    if (magnitude >= 0x7f800000u)  // infinity or NaN
+        return sign | 0x7c00u | (magnitude > 0x7f800000u ? 0x200u : 0u);
+    if (magnitude >= 0x477ff000u)  // overflows to infinity
+        return sign | 0x7c00u;
+    if (magnitude < 0x38800000u)  // denormal or zero
+    {
+        if (magnitude < 0x33000000u) return sign;
+        uint32_t mantissa = (magnitude & 0x7fffffu) | 0x800000u;
+        int      shift = 126 - (int)(magnitude >> 23);
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1u);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1u))) ++half;
+        return sign | (uint16_t)half;
+    }
+    uint32_t half = (magnitude - 0x38000000u) >> 13;
+    uint32_t rest = magnitude & 0x1fffu;
+    if (rest > 0x1000u || (rest == 0x1000u && (half & 1u))) ++half;
+    return sign | (uint16_t)half;
 }
 
-TGAImage Buffer1f::GenerateImage(bool inverseColor) const
+float PixelFormat::HalfToFloat(uint16_t bits)
 {
-    TGAImage image(m_Width, m_Height, TGAImage::GRAYSCALE);
-    for (int x = 0; x < m_Width; ++x)
+    uint32_t sign = (uint32_t)(bits & 0x8000u) << 16;
+    uint32_t exponent = (bits >> 10) & 0x1fu;
+    uint32_t mantissa = bits & 0x3ffu;
+    uint32_t result;
+    if (exponent == 0x1fu)  // infinity or NaN
     {
-        for (int y = 0; y < m_Height; ++y)
-        {
-            Float val = (inverseColor) ? 1.f - GetValue(x, y) : GetValue(x, y);
-            image.Set(x, y, TGAColor(val * 255));
-        }
+        result = sign | 0x7f800000u | (mantissa << 13);
     }
-    return image;
+    else if (exponent != 0)
+    {
+        result = sign | ((exponent + 112u) << 23) | (mantissa << 13);
+    }
+    else  // denormal or zero
+    {
+        float value = std::ldexp((float)mantissa, -24);
+        std::memcpy(&result, &value, sizeof(result));
+        result |= sign;
+    }
+    float value;
+    std::memcpy(&value, &result, sizeof(value));
+    return value;
 }
 
-// Post-Processing
-void Buffer1f::SimpleBlurDenoised()
+// TypedBuffer
+static Float GetInitValue(Buffer::InitType type)
 {
-    const Float scale = 1 / 9.f;
-
-    for (int h = 0; h < m_Height; ++h)
+    switch (type)
     {
-        for (int w = 0; w < m_Width; ++w)
-        {
-            Float result = 0.f;
-
-            for (int xOffset = -1; xOffset <= 1; ++xOffset)
-            {
-                for (int yOffset = -1; yOffset <= 1; ++yOffset)
-                {
-                    int newW = Clamp(w + xOffset, 0, m_Width - 1);
-                    int newH = Clamp(h + yOffset, 0, m_Height - 1);
-                    result += GetValue(newW, newH) * scale;
-                }
-            }
-            SetValue(w, h, result);
-        }
+        case Buffer::One: return 1.f;
+        case Buffer::MaxPositive: return MaxFloat;
+        case Buffer::MinNegative: return MinFloat;
+        default: return 0.f;
     }
 }
 
-void Buffer1f::TwoPassGaussianBlurDenoised()
+// Texels per row alignment, so that every row starts on an aligned address
+static int GetRowAlignment(size_t texelSize)
 {
-    const Float weights[5] = { 0.227027, 0.1945946, 0.1216216, 0.054054, 0.016216 };
-
-    // Horizontal Pass
-    for (int h = 0; h < m_Height; ++h)
+    size_t a = AlignedAllocator<uint8_t>::Alignment, b = texelSize;
+    while (b != 0)
     {
-        for (int w = 0; w < m_Width; ++w)
-        {
-            Float result = GetValue(w, h) * weights[0];
-
-            for (int i = 1; i < 5; ++i)
-            {
-                int w1 = Clamp(w + i, 0, m_Width - 1);
-                int w2 = Clamp(w - i, 0, m_Width - 1);
-                result += GetValue(w1, h) * weights[i];
-                result += GetValue(w2, h) * weights[i];
-            }
-            SetValue(w, h, result);
-        }
+        size_t r = a % b;
+        a = b;
+        b = r;
     }
+    return (int)(AlignedAllocator<uint8_t>::Alignment / a);  // alignment / gcd
+}
 
-    // Vertical Pass
-    for (int h = 0; h < m_Height; ++h)
-    {
-        for (int w = 0; w < m_Width; ++w)
-        {
-            Float result = GetValue(w, h) * weights[0];
+template <typename Format, typename Layout>
+TypedBuffer<Format, Layout>::TypedBuffer(int w, int h, InitType type)
+    : TypedBuffer(w, h, Value(GetInitValue(type)))
+{
+}
 
-            for (int i = 1; i < 5; ++i)
-            {
-                int h1 = Clamp(h + i, 0, m_Height - 1);
-                int h2 = Clamp(h - i, 0, m_Height - 1);
-                result += GetValue(w, h1) * weights[i];
-                result += GetValue(w, h2) * weights[i];
-            }
-            SetValue(w, h, result);
-        }
-    }
+template <typename Format, typename Layout>
+TypedBuffer<Format, Layout>::TypedBuffer(int w, int h, const Value& value)
+    : Buffer(0, 0), m_Pitch(0)
+{
+    Reset(w, h, value);
 }
 
-// Buffer3f
-Buffer3f::Buffer3f(int w, int h, InitType type) : Buffer(w, h)
+template <typename Format, typename Layout>
+void TypedBuffer<Format, Layout>::Reset(int w, int h, InitType type)
 {
-    if (type == Zero)
-        m_Data = std::vector<Data>(w * h, Data(0.f));
-    else if (type == One)
-        m_Data = std::vector<Data>(w * h, Data(1.f));
-    else if (type == MaxPositive)
-        m_Data = std::vector<Data>(w * h, Data(MaxFloat));
-    else if (type == MinNegative)
-        m_Data = std::vector<Data>(w * h, Data(MinFloat));
+    Reset(w, h, Value(GetInitValue(type)));
 }
 
-TGAImage Buffer3f::GenerateImage() const
+template <typename Format, typename Layout>
+void TypedBuffer<Format, Layout>::Reset(int w, int h, const Value& value)
 {
-    TGAImage image(m_Width, m_Height, TGAImage::RGB);
-    for (int x = 0; x < m_Width; ++x)
+    Resize(w, h);
+    Clear(value);
+}
+
+template <typename Format, typename Layout>
+void TypedBuffer<Format, Layout>::Resize(int w, int h)
+{
+    // Blocks of 64 texels start on aligned addresses as well
+    int alignment = (Layout::BlockSize > 1) ? Layout::BlockSize
+                                            : GetRowAlignment(sizeof(Storage));
+    int rows = (h + Layout::BlockSize - 1) / Layout::BlockSize * Layout::BlockSize;
+    int pitch = (w + alignment - 1) / alignment * alignment;
+
+    // Only growing past the capacity allocates
+    m_Data.resize((size_t)pitch * rows);
+    if (Layout::UseOffsetTables && (pitch != m_Pitch || h != m_Height))
     {
-        for (int y = 0; y < m_Height; ++y)
-        {
-            const Vector3f& color = GetValue(x, y);
-            image.Set(x, y,
-                      TGAColor(color.r * 254.99f, color.g * 254.99f, color.b * 254.99f));
-        }
+        m_OffsetsX.resize(pitch);
+        m_OffsetsY.resize(rows);
+        for (int x = 0; x < pitch; ++x)
+            m_OffsetsX[x] = Layout::GetOffsetX(x);
+        for (int y = 0; y < rows; ++y)
+            m_OffsetsY[y] = Layout::GetOffsetY(y, pitch);
     }
-    return image;
+    m_Width = w;
+    m_Height = h;
+    m_Pitch = pitch;
+}
+
+template <typename Format, typename Layout>
+void TypedBuffer<Format, Layout>::Clear(const Value& value)
+{
+    std::fill(m_Data.begin(), m_Data.end(), Format::Encode(value));  // padding included
+}
+
+// Image Conversion
+static TGAImage::Format GetImageFormat(Float) { return TGAImage::GRAYSCALE; }
+static TGAImage::Format GetImageFormat(uint32_t) { return TGAImage::GRAYSCALE; }
+static TGAImage::Format GetImageFormat(const Vector2f&) { return TGAImage::RGB; }
+static TGAImage::Format GetImageFormat(const Vector3f&) { return TGAImage::RGB; }
+static TGAImage::Format GetImageFormat(const Vector4f&) { return TGAImage::RGB; }
+
+static TGAColor GetImageColor(Float value, bool inverseColor)
+{
+    Float val = (inverseColor) ? 1.f - value : value;
+    return TGAColor(val * 255);
+}
+
+static TGAColor GetImageColor(uint32_t value, bool)
+{
+    return TGAColor((std::uint8_t)value);
+}
+
+static TGAColor GetImageColor(const Vector3f& value, bool inverseColor)
+{
+    Vector3f color = (inverseColor) ? Vector3f(1.f) - value : value;
+    return TGAColor(color.r * 254.99f, color.g * 254.99f, color.b * 254.99f);
+}
+
+static TGAColor GetImageColor(const Vector2f& value, bool inverseColor)
+{
+    return GetImageColor(Vector3f(value.x, value.y, 0.f), inverseColor);
 }
 
-void Buffer3f::PaintColor(const Color3& color)
+static TGAColor GetImageColor(const Vector4f& value, bool inverseColor)
 {
+    return GetImageColor(value.xyz, inverseColor);
+}
+
+template <typename Format, typename Layout>
+TGAImage TypedBuffer<Format, Layout>::GenerateImage(bool inverseColor) const
+{
+    TGAImage image(m_Width, m_Height, GetImageFormat(Value()));
     for (int x = 0; x < m_Width; ++x)
     {
         for (int y = 0; y < m_Height; ++y)
         {
-            SetValue(x, y, color);
+            image.Set(x, y, GetImageColor(GetValue(x, y), inverseColor));
         }
     }
+    return image;
 }
 
 // Post-Processing
-void Buffer3f::SimpleBlurDenoised()
+template <typename Format, typename Layout>
+void TypedBuffer<Format, Layout>::SimpleBlurDenoised()
 {
     const Float scale = 1 / 9.f;
 
@@ -145,7 +201,7 @@ void Buffer3f::SimpleBlurDenoised()
     {
         for (int w = 0; w < m_Width; ++w)
         {
-            Vector3f result(0.f);
+            Value result(0.f);
 
             for (int xOffset = -1; xOffset <= 1; ++xOffset)
             {
@@ -161,7 +217,8 @@ void Buffer3f::SimpleBlurDenoised()
     }
 }
 
-void Buffer3f::TwoPassGaussianBlurDenoised()
+template <typename Format, typename Layout>
+void TypedBuffer<Format, Layout>::TwoPassGaussianBlurDenoised()
 {
     const Float weights[5] = { 0.227027, 0.1945946, 0.1216216, 0.054054, 0.016216 };
 
@@ -170,7 +227,7 @@ void Buffer3f::TwoPassGaussianBlurDenoised()
     {
         for (int w = 0; w < m_Width; ++w)
         {
-            Vector3f result = GetValue(w, h) * weights[0];
+            Value result = GetValue(w, h) * weights[0];
 
             for (int i = 1; i < 5; ++i)
             {
@@ -188,7 +245,7 @@ void Buffer3f::TwoPassGaussianBlurDenoised()
     {
         for (int w = 0; w < m_Width; ++w)
         {
-            Vector3f result = GetValue(w, h) * weights[0];
+            Value result = GetValue(w, h) * weights[0];
 
             for (int i = 1; i < 5; ++i)
             {
@@ -200,4 +257,52 @@ void Buffer3f::TwoPassGaussianBlurDenoised()
             SetValue(w, h, result);
         }
     }
-}
\ No newline at end of file
+}
+
+template class TypedBuffer<PixelFormat::R8>;
+template class TypedBuffer<PixelFormat::RG16>;
+template class TypedBuffer<PixelFormat::RGBA8>;
+template class TypedBuffer<PixelFormat::R16F>;
+template class TypedBuffer<PixelFormat::R32F>;
+template class TypedBuffer<PixelFormat::RGB32F>;
+template class TypedBuffer<PixelFormat::D24>;
+template class TypedBuffer<PixelFormat::R32UI>;
+template class TypedBuffer<PixelFormat::R32F, PixelLayout::Tiled>;
+template class TypedBuffer<PixelFormat::R32F, PixelLayout::Morton>;
+template class TypedBuffer<PixelFormat::D24, PixelLayout::Tiled>;
+template class TypedBuffer<PixelFormat::D24, PixelLayout::Morton>;
+
+// DepthPayloadBuffer
+DepthPayloadBuffer::DepthPayloadBuffer(int w, int h, uint32_t payload) : Buffer(0, 0)
+{
+    Reset(w, h, payload);
+}
+
+void DepthPayloadBuffer::Reset(int w, int h, uint32_t payload)
+{
+    if (w * h > m_Capacity)
+    {
+        m_Data.reset(new std::atomic<uint64_t>[w * h]);
+        m_Capacity = w * h;
+    }
+    m_Width = w;
+    m_Height = h;
+
+    uint64_t cleared = Pack(MaxFloat, payload);
+    for (int i = 0; i < w * h; ++i)
+        m_Data[i].store(cleared, std::memory_order_relaxed);
+}
+
+Float DepthPayloadBuffer::GetDepth(int x, int y) const
+{
+    uint64_t packed = m_Data[x + y * m_Width].load(std::memory_order_relaxed);
+    uint32_t bits = (uint32_t)(packed >> 32);
+    float    depth;
+    std::memcpy(&depth, &bits, sizeof(depth));
+    return depth;
+}
+
+uint32_t DepthPayloadBuffer::GetPayload(int x, int y) const
+{
+    return (uint32_t)m_Data[x + y * m_Width].load(std::memory_order_relaxed);
+}
@@ -4,6 +4,11 @@
 
 #pragma once
 
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <memory>
 #include <vector>
 
 #include "color.h"
@@ -31,65 +36,289 @@ protected:
     int m_Height;
 };
 
-class Buffer1f : public Buffer
+// Allocator of 64-byte aligned blocks (cache lines & the widest SIMD registers)
+template <typename T>
+struct AlignedAllocator
 {
-public:
-    Buffer1f() : Buffer(0, 0) { }
-    explicit Buffer1f(int w, int h, InitType type);
+    static const size_t Alignment = 64;
+    using value_type = T;
 
-    Float GetValue(int x, int y) const { return m_Data[x + y * m_Width].value; }
-    void  SetValue(int x, int y, Float val) { m_Data[x + y * m_Width].value = val; }
+    AlignedAllocator() = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U>&)
+    {
+    }
 
-    TGAImage GenerateImage(bool inverseColor = false) const;
+    T* allocate(size_t n)
+    {
+        // The unaligned block is stored right before the aligned one
+        void*     block = ::operator new(n * sizeof(T) + Alignment + sizeof(void*));
+        uintptr_t start = (uintptr_t)block + sizeof(void*) + Alignment - 1;
+        void*     aligned = (void*)(start & ~(uintptr_t)(Alignment - 1));
+        ((void**)aligned)[-1] = block;
+        return (T*)aligned;
+    }
+    void deallocate(T* p, size_t) { ::operator delete(((void**)p)[-1]); }
 
-    // Post-Processing
-    void SimpleBlurDenoised();
-    void TwoPassGaussianBlurDenoised();
+    template <typename U>
+    bool operator==(const AlignedAllocator<U>&) const
+    {
+        return true;
+    }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U>&) const
+    {
+        return false;
+    }
+};
 
-private:
-    struct Data
+// Pixel Formats: the stored texel (Storage) and the value it is read & written as
+// (Value). Normalized formats clamp to [0, 1] on writes.
+namespace PixelFormat
+{
+uint16_t FloatToHalf(float value);
+float    HalfToFloat(uint16_t bits);
+
+struct R8  // unorm8
+{
+    using Storage = uint8_t;
+    using Value = Float;
+    static Storage Encode(Value v) { return (Storage)(Clamp01(v) * 255.f + 0.5f); }
+    static Value   Decode(Storage v) { return v / 255.f; }
+};
+
+struct RG16  // 2 x unorm16
+{
+    struct Storage
+    {
+        uint16_t r, g;
+    };
+    using Value = Vector2f;
+    static Storage Encode(const Value& v)
+    {
+        return { (uint16_t)(Clamp01(v.x) * 65535.f + 0.5f),
+                 (uint16_t)(Clamp01(v.y) * 65535.f + 0.5f) };
+    }
+    static Value Decode(Storage v) { return Value(v.r / 65535.f, v.g / 65535.f); }
+};
+
+struct RGBA8  // 4 x unorm8
+{
+    struct Storage
     {
-        Data() : value(0.f) { }
-        explicit Data(float v) : value(v) { }
-        Float value;
+        uint8_t r, g, b, a;
     };
-    std::vector<Data> m_Data;
+    using Value = Vector4f;
+    static Storage Encode(const Value& v)
+    {
+        return { R8::Encode(v.x), R8::Encode(v.y), R8::Encode(v.z), R8::Encode(v.w) };
+    }
+    static Value Decode(Storage v)
+    {
+        return Value(R8::Decode(v.r), R8::Decode(v.g), R8::Decode(v.b), R8::Decode(v.a));
+    }
+};
+
+struct R16F  // half
+{
+    using Storage = uint16_t;
+    using Value = Float;
+    static Storage Encode(Value v) { return FloatToHalf((float)v); }
+    static Value   Decode(Storage v) { return HalfToFloat(v); }
+};
+
+struct R32F  // Float
+{
+    using Storage = Float;
+    using Value = Float;
+    static Storage Encode(Value v) { return v; }
+    static Value   Decode(Storage v) { return v; }
+};
+
+struct RGB32F  // 3 x Float
+{
+    using Storage = Vector3f;
+    using Value = Vector3f;
+    static Storage Encode(const Value& v) { return v; }
+    static Value   Decode(const Storage& v) { return v; }
+};
+
+struct D24  // unorm24 depth in [0, 1] (the upper 8 bits are unused)
+{
+    using Storage = uint32_t;
+    using Value = Float;
+    static Storage Encode(Value v) { return (Storage)(Clamp01(v) * 16777215.f + 0.5f); }
+    static Value   Decode(Storage v) { return (Value)(v / 16777215.0); }
 };
 
-class Buffer3f : public Buffer
+struct R32UI  // ids
+{
+    using Storage = uint32_t;
+    using Value = uint32_t;
+    static Storage Encode(Value v) { return v; }
+    static Value   Decode(Storage v) { return v; }
+};
+}  // namespace PixelFormat
+
+// Pixel Layouts: the offset of texel (x, y) in a buffer with pitch texels per row is
+// GetOffsetX(x) + GetOffsetY(y, pitch). Blocked layouts keep both terms in tables, so
+// a scattered read costs two lookups instead of the bit arithmetic. Texels of a span,
+// from x up to the next multiple of SpanWidth, are contiguous.
+namespace PixelLayout
+{
+struct Linear  // row-major (rows are padded to start on 64-byte boundaries)
+{
+    static const int  BlockSize = 1;
+    static const int  SpanWidth = INT_MAX;
+    static const bool UseOffsetTables = false;
+    static int        GetOffsetX(int x) { return x; }
+    static int        GetOffsetY(int y, int pitch) { return y * pitch; }
+};
+
+// 8x8 blocks in row-major order, so that 2D neighborhoods share cache lines
+struct Tiled  // row-major in a block
+{
+    static const int  BlockSize = 8;
+    static const int  SpanWidth = 8;
+    static const bool UseOffsetTables = true;
+    static int        GetOffsetX(int x) { return (x & ~7) * 8 + (x & 7); }
+    static int        GetOffsetY(int y, int pitch)
+    {
+        return (y >> 3) * pitch * 8 + ((y & 7) << 3);
+    }
+};
+
+struct Morton  // Z-order in a block (x bits at even positions)
+{
+    static const int  BlockSize = 8;
+    static const int  SpanWidth = 1;
+    static const bool UseOffsetTables = true;
+    static int        GetOffsetX(int x) { return (x & ~7) * 8 + Spread(x & 7); }
+    static int        GetOffsetY(int y, int pitch)
+    {
+        return (y >> 3) * pitch * 8 + (Spread(y & 7) << 1);
+    }
+
+private:
+    static int Spread(int v)  // 3 bits: abc -> a0b0c
+    {
+        v = (v | (v << 2)) & 0x13;
+        return (v | (v << 1)) & 0x15;
+    }
+};
+}  // namespace PixelLayout
+
+// Buffer of one pixel format and layout. Storage is 64-byte aligned (blocks of the
+// tiled layouts are, too), so contiguous spans can be loaded by SIMD kernels.
+template <typename Format, typename Layout = PixelLayout::Linear>
+class TypedBuffer : public Buffer
 {
 public:
-    Buffer3f() : Buffer(0, 0) { }
-    explicit Buffer3f(int w, int h, InitType type);
+    using Storage = typename Format::Storage;
+    using Value = typename Format::Value;
+
+    TypedBuffer() : Buffer(0, 0), m_Pitch(0) { }
+    explicit TypedBuffer(int w, int h, InitType type);
+    explicit TypedBuffer(int w, int h, const Value& value);
 
-    Vector3f GetValue(int x, int y) const
+    // Render targets are reset in place, which reuses the storage of earlier passes
+    // and frames (only a larger size than ever before allocates)
+    void Reset(int w, int h, InitType type);
+    void Reset(int w, int h, const Value& value);
+    void Resize(int w, int h);       // texels are left undefined
+    void Clear(const Value& value);  // fills the whole storage
+
+    // Layout conversion (texels are copied without decoding)
+    template <typename OtherLayout>
+    explicit TypedBuffer(const TypedBuffer<Format, OtherLayout>& other)
+        : TypedBuffer(other.GetWidth(), other.GetHeight(), Value())
+    {
+        for (int y = 0; y < m_Height; ++y)
+        {
+            for (int x = 0; x < m_Width; ++x)
+                m_Data[GetIndex(x, y)] = other.m_Data[other.GetIndex(x, y)];
+        }
+    }
+
+    Value GetValue(int x, int y) const { return Format::Decode(m_Data[GetIndex(x, y)]); }
+    void  SetValue(int x, int y, const Value& val)
     {
-        int index = x + y * m_Width;
-        return Vector3f(m_Data[index].value);
+        m_Data[GetIndex(x, y)] = Format::Encode(val);
     }
 
-    void SetValue(int x, int y, const Vector3f& value)
+    // Offset of a texel in the storage (linear coordinates -> layout)
+    int GetIndex(int x, int y) const
     {
-        int index = x + y * m_Width;
-        m_Data[index].value = value;
+        return Layout::UseOffsetTables
+                   ? m_OffsetsX[x] + m_OffsetsY[y]
+                   : Layout::GetOffsetX(x) + Layout::GetOffsetY(y, m_Pitch);
     }
+    int GetPitch() const { return m_Pitch; }  // texels per padded row
 
-    TGAImage GenerateImage() const;
+    // Raw texels from (x, y) to the next multiple of Layout::SpanWidth (for SIMD kernels)
+    const Storage* GetSpan(int x, int y) const { return &m_Data[GetIndex(x, y)]; }
+    Storage*       GetSpan(int x, int y) { return &m_Data[GetIndex(x, y)]; }
 
-    // Paint Background Before Rendering
-    void PaintColor(const Color3& color);
+    TGAImage GenerateImage(bool inverseColor = false) const;
 
     // Post-Processing
     void SimpleBlurDenoised();
     void TwoPassGaussianBlurDenoised();
 
 private:
-    struct Data
+    template <typename, typename>
+    friend class TypedBuffer;
+
+    std::vector<Storage, AlignedAllocator<Storage>> m_Data;
+    int                                             m_Pitch;
+    std::vector<int> m_OffsetsX, m_OffsetsY;  // blocked layouts
+};
+
+using Buffer1f = TypedBuffer<PixelFormat::R32F>;
+using Buffer3f = TypedBuffer<PixelFormat::RGB32F>;
+using Buffer1u = TypedBuffer<PixelFormat::R32UI>;  // integer ids (visibility buffer)
+using BufferR8 = TypedBuffer<PixelFormat::R8>;
+using BufferD24 = TypedBuffer<PixelFormat::D24>;
+using TiledBuffer1f = TypedBuffer<PixelFormat::R32F, PixelLayout::Tiled>;  // depths
+
+// Depth and a 32-bit payload (e.g. a visibility id) packed into one 64-bit word, depth
+// bits above. An atomic minimum keeps the nearest fragment, and the smallest payload on
+// equal depths, so any thread can write any pixel without locks.
+class DepthPayloadBuffer : public Buffer
+{
+public:
+    DepthPayloadBuffer() : Buffer(0, 0) { }
+    explicit DepthPayloadBuffer(int w, int h, uint32_t payload);  // at MaxFloat depth
+
+    void Reset(int w, int h, uint32_t payload);  // reallocates only to grow
+
+    // Atomic compare-and-swap minimum, returns true if the fragment was written
+    bool TestAndSet(int x, int y, Float depth, uint32_t payload)
     {
-        Data() : value(0.f) { }
-        explicit Data(Float v) : value(v) { }
-        explicit Data(Float x, Float y, Float z) : value(x, y, z) { }
-        Vector3f value;
-    };
-    std::vector<Data> m_Data;
+        std::atomic<uint64_t>& word = m_Data[x + y * m_Width];
+        uint64_t               packed = Pack(depth, payload);
+        uint64_t               stored = word.load(std::memory_order_relaxed);
+        while (packed < stored)
+        {
+            if (word.compare_exchange_weak(stored, packed, std::memory_order_relaxed))
+                return true;
+        }
+        return false;
+    }
+
+    Float    GetDepth(int x, int y) const;
+    uint32_t GetPayload(int x, int y) const;
+
+private:
+    // Non-negative floats keep their order when compared as unsigned integers
+    static uint64_t Pack(Float depth, uint32_t payload)
+    {
+        float    value = (depth > 0.f) ? (float)depth : 0.f;
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return ((uint64_t)bits << 32) | payload;
+    }
+
+    std::unique_ptr<std::atomic<uint64_t>[]> m_Data;
+    int                                      m_Capacity = 0;
 };
@@ -4,14 +4,22 @@
 
 #include "forkergl.h"
 
-#include <thread>
+#include <algorithm>
+#include <atomic>
+#include <typeinfo>
+
+#include <spdlog/spdlog.h>
 
 #include "color.h"
+#include "depthshader.h"
 #include "gshader.h"
+#include "lightingkernel.h"
 #include "pbrshader.h"
 #include "phongshader.h"
+#include "rasterkernel.h"
 #include "scene.h"
 #include "tgaimage.h"
+#include "threadpool.h"
 
 // Texture Wrapping & Filtering
 Texture::WrapMode   ForkerGL::TextureWrapping = Texture::WrapMode::NoWrap;
@@ -19,16 +27,22 @@ Texture::FilterMode ForkerGL::TextureFiltering = Texture::FilterMode::Nearest;
 
 // Buffers
 Buffer3f ForkerGL::FrameBuffer;  // Lighting Pass & Forward Pass
-Buffer1f ForkerGL::DepthBuffer;
-Buffer1f ForkerGL::ShadowBuffer;  // Shadow Pass
+TiledBuffer1f ForkerGL::DepthBuffer;
+HiZBuffer ForkerGL::DepthHiZBuffer;
+BufferD24 ForkerGL::ShadowBuffer;  // Shadow Pass
 Buffer3f ForkerGL::NormalGBuffer;  // Geometry Pass
 Buffer3f ForkerGL::WorldPosGBuffer;
 Buffer3f ForkerGL::LightSpaceNDCPosGBuffer;
 Buffer3f ForkerGL::AlbedoGBuffer;
 Buffer3f ForkerGL::EmissiveGBuffer;
 Buffer3f ForkerGL::ParamGBuffer;
-Buffer1f ForkerGL::ShadingTypeGBuffer;
-Buffer1f ForkerGL::AmbientOcclusionGBuffer;  // SSAO
+BufferR8 ForkerGL::ShadingTypeGBuffer;
+PackedGBuffer ForkerGL::PackedGBuffers;
+BufferR8 ForkerGL::AmbientOcclusionGBuffer;  // SSAO
+TiledBuffer1f ForkerGL::SampleDepthBuffer;  // MSAA
+Buffer3f ForkerGL::SampleColorBuffer;
+Buffer1u ForkerGL::VisibilityBuffer;  // Visibility Pass
+DepthPayloadBuffer ForkerGL::VisibilityDepthBuffer;
 
 // Images
 TGAImage ForkerGL::AntiAliasedImage;
@@ -37,10 +51,53 @@ TGAImage ForkerGL::AntiAliasedImage;
 Matrix4x4f viewProjectionMatrix = Matrix4x4f::Identity();
 Matrix4x4f viewportMatrix = Matrix4x4f::Identity();
 Matrix4x4f lightSpaceMatrix = Matrix4x4f::Identity();
+static Matrix4x4f s_ScreenToWorldMatrix = Matrix4x4f::Identity();  // packed G-buffers
 
 // Rendering
 enum ForkerGL::RenderMode renderMode = ForkerGL::Forward;
 enum ForkerGL::PassType   passType = ForkerGL::ForwardPass;
+enum ForkerGL::DepthFunc  depthFunc = ForkerGL::Less;
+enum ForkerGL::CullMode   cullModes[ForkerGL::NumPassTypes] = {};  // CullNone
+static const Buffer1f*    s_PixelMask = nullptr;
+static ForkerGL::GBufferFormat s_GBufferFormat = ForkerGL::FullPrecision;
+
+// Multithreading
+static int                         s_ThreadCount = ThreadPool::GetHardwareThreadCount();
+static int                         s_TileSize = 64;
+static std::unique_ptr<ThreadPool> s_ThreadPool;
+static bool                        s_SortLast = false;
+
+// Multisampling
+static const int s_MaxSampleCount = 8;
+static int       s_SampleCount = 1;
+
+// Standard sample positions in 1/16 pixels from the pixel center, the pattern of N
+// samples starts at index N - 1
+static const int s_SamplePositions[2 * s_MaxSampleCount - 1][2] = {
+    { 0, 0 },                                                        // x1
+    { 4, 4 }, { -4, -4 },                                            // x2
+    { -2, -6 }, { 6, -2 }, { -6, 2 }, { 2, 6 },                      // x4
+    { 1, -3 }, { -1, 3 }, { 5, 1 }, { -3, -5 },                      // x8
+    { -5, 5 }, { -7, -1 }, { 3, 7 }, { 7, -7 }
+};
+
+// Visibility Buffer: draw id in the high bits and face id in the low bits, all ones
+// for the background
+struct VisibilityDraw
+{
+    DrawContext   context;
+    const Shader* shader;
+};
+
+static const int                  s_VisibilityFaceBits = 22;
+static const uint32_t             s_VisibilityFaceMask = (1u << s_VisibilityFaceBits) - 1;
+static const int                  s_MaxVisibilityDraws = (1 << 10) - 1;  // 32 - 22 bits
+static const uint32_t             s_InvalidVisibilityId = ~0u;
+static std::vector<VisibilityDraw> s_VisibilityDraws;
+
+// Statistics
+static std::atomic<long long> s_FragmentCount(0);
+static ForkerGL::TriangleStats s_TriangleStats;
 
 // Texture Wrap Mode & Filter Mode
 void ForkerGL::TextureWrapMode(Texture::WrapMode wrapMode)
@@ -56,39 +113,62 @@ void ForkerGL::TextureFilterMode(Texture::FilterMode filterMode)
 // Buffer Initialization
 void ForkerGL::InitFrameBuffer(int width, int height)
 {
-    FrameBuffer = Buffer3f(width, height, Buffer::Zero);
+    // Unused targets are reset to an empty size, which keeps their storage around
+    int sampleWidth = (s_SampleCount > 1) ? width : 0;
+    FrameBuffer.Reset(width, height, Buffer::Zero);
+    SampleColorBuffer.Reset(sampleWidth, height * s_SampleCount, Buffer::Zero);
 }
 
 void ForkerGL::InitDepthBuffer(int width, int height)
 {
-    DepthBuffer = Buffer1f(width, height, Buffer::MaxPositive);
+    // Fast clear: only the blocks are flagged, their depths are written on first use
+    DepthBuffer.Resize(width, height);
+    DepthHiZBuffer.Clear(width, height, s_TileSize);
+    SampleDepthBuffer.Reset((s_SampleCount > 1) ? width : 0, height * s_SampleCount,
+                            Buffer::MaxPositive);
 }
 
 void ForkerGL::InitShadowBuffer(int width, int height)
 {
-    ShadowBuffer = Buffer1f(width, height, Buffer::Zero);
+    ShadowBuffer.Reset(width, height, Buffer::Zero);
 }
 
 void ForkerGL::InitGeometryBuffers(int width, int height)
 {
-    NormalGBuffer = Buffer3f(width, height, Buffer::Zero);
-    WorldPosGBuffer = Buffer3f(width, height, Buffer::Zero);
-    if (Shadow::GetShadowStatus())
-        LightSpaceNDCPosGBuffer = Buffer3f(width, height, Buffer::Zero);
-    AlbedoGBuffer = Buffer3f(width, height, Buffer::Zero);
-    EmissiveGBuffer = Buffer3f(width, height, Buffer::Zero);
-    ParamGBuffer = Buffer3f(width, height, Buffer::Zero);
-    ShadingTypeGBuffer = Buffer1f(width, height, Buffer::Zero);
-    AmbientOcclusionGBuffer = Buffer1f(width, height, Buffer::One);
+    int sampleHeight = height * s_SampleCount;  // one plane per sample
+    if (s_GBufferFormat == Packed)
+    {
+        PackedGBuffers.Reset(width, sampleHeight);
+    }
+    else
+    {
+        NormalGBuffer.Reset(width, sampleHeight, Buffer::Zero);
+        WorldPosGBuffer.Reset(width, sampleHeight, Buffer::Zero);
+        if (Shadow::GetShadowStatus())
+            LightSpaceNDCPosGBuffer.Reset(width, sampleHeight, Buffer::Zero);
+        AlbedoGBuffer.Reset(width, sampleHeight, Buffer::Zero);
+        EmissiveGBuffer.Reset(width, sampleHeight, Buffer::Zero);
+        ParamGBuffer.Reset(width, sampleHeight, Buffer::Zero);
+        ShadingTypeGBuffer.Reset(width, sampleHeight, Buffer::Zero);
+    }
+    AmbientOcclusionGBuffer.Reset(width, height, Buffer::One);
+}
+
+void ForkerGL::InitVisibilityBuffer(int width, int height)
+{
+    VisibilityBuffer.Reset(width, height, s_InvalidVisibilityId);
+    VisibilityDepthBuffer.Reset(s_SortLast ? width : 0, height, s_InvalidVisibilityId);
+    s_VisibilityDraws.clear();
 }
 
 // Status Configuration
 void ForkerGL::ClearColor(const Color3& color)
 {
-    FrameBuffer.PaintColor(color);
+    FrameBuffer.Clear(color);
+    SampleColorBuffer.Clear(color);
 }
 
-void ForkerGL::SetViewportMatrix(int x, int y, int w, int h)
+void ForkerGL::SetViewportMatrix(Float x, Float y, int w, int h)
 {
     viewportMatrix = Matrix4x4f::Identity();
 
@@ -101,6 +181,8 @@ void ForkerGL::SetViewportMatrix(int x, int y, int w, int h)
     // for z
     viewportMatrix[2][2] = 1 / 2.f;
     viewportMatrix[2][3] = 1 / 2.f;
+
+    s_ScreenToWorldMatrix = (viewportMatrix * viewProjectionMatrix).Inverse();
 }
 
 Matrix4x4f ForkerGL::GetViewportMatrix()
@@ -111,6 +193,7 @@ Matrix4x4f ForkerGL::GetViewportMatrix()
 void ForkerGL::SetViewProjectionMatrix(const Matrix4x4f& matrix)
 {
     viewProjectionMatrix = matrix;
+    s_ScreenToWorldMatrix = (viewportMatrix * viewProjectionMatrix).Inverse();
 }
 
 Matrix4x4f ForkerGL::GetViewProjectionMatrix()
@@ -143,110 +226,950 @@ void ForkerGL::SetPassType(enum PassType type)
     passType = type;
 }
 
+void ForkerGL::SetDepthFunc(enum DepthFunc func)
+{
+    depthFunc = func;
+}
+
+ForkerGL::DepthFunc ForkerGL::GetDepthFunc()
+{
+    return depthFunc;
+}
+
+void ForkerGL::SetCullMode(enum PassType pass, enum CullMode mode)
+{
+    cullModes[pass] = mode;
+}
+
+ForkerGL::CullMode ForkerGL::GetCullMode(enum PassType pass)
+{
+    return cullModes[pass];
+}
+
+void ForkerGL::SetGBufferFormat(enum GBufferFormat format)
+{
+    s_GBufferFormat = format;
+}
+
+ForkerGL::GBufferFormat ForkerGL::GetGBufferFormat()
+{
+    return s_GBufferFormat;
+}
+
+void ForkerGL::SetPixelMask(const Buffer1f* mask)
+{
+    s_PixelMask = mask;
+}
+
+void ForkerGL::ResetFragmentCount()
+{
+    s_FragmentCount = 0;
+}
+
+long long ForkerGL::GetFragmentCount()
+{
+    return s_FragmentCount;
+}
+
+void ForkerGL::ResetTriangleStats()
+{
+    s_TriangleStats = TriangleStats();
+}
+
+const ForkerGL::TriangleStats& ForkerGL::GetTriangleStats()
+{
+    return s_TriangleStats;
+}
+
+void ForkerGL::SetThreadCount(int count)
+{
+    s_ThreadCount = (count > 0) ? count : ThreadPool::GetHardwareThreadCount();
+    s_ThreadPool.reset();  // recreated on next use
+}
+
+int ForkerGL::GetThreadCount()
+{
+    return s_ThreadCount;
+}
+
+void ForkerGL::SetTileSize(int size)
+{
+    Flush();
+
+    // Tiles are made of whole Hi-Z blocks so that every block is owned by one tile
+    int blockSize = HiZBuffer::BlockSize;
+    s_TileSize = Max((size + blockSize - 1) / blockSize * blockSize, blockSize);
+    DepthHiZBuffer.SetTileSize(s_TileSize);
+}
+
+int ForkerGL::GetTileSize()
+{
+    return s_TileSize;
+}
+
+ThreadPool& ForkerGL::GetThreadPool()
+{
+    if (!s_ThreadPool) s_ThreadPool = std::make_unique<ThreadPool>(s_ThreadCount);
+    return *s_ThreadPool;
+}
+
+void ForkerGL::SetSortLast(bool enabled)
+{
+    s_SortLast = enabled;
+}
+
+bool ForkerGL::IsSortLastOn()
+{
+    return s_SortLast;
+}
+
+void ForkerGL::SetSampleCount(int count)
+{
+    s_SampleCount = (count == 2 || count == 4 || count == 8) ? count : 1;
+}
+
+int ForkerGL::GetSampleCount()
+{
+    return s_SampleCount;
+}
+
+void ForkerGL::ResolveFrameBuffer()
+{
+    if (s_SampleCount == 1) return;
+
+    int   width = FrameBuffer.GetWidth();
+    int   height = FrameBuffer.GetHeight();
+    Float weight = 1.f / s_SampleCount;
+
+    GetThreadPool().ParallelFor(height, [&](int y) {
+        for (int x = 0; x < width; ++x)
+        {
+            Color3 color;
+            for (int s = 0; s < s_SampleCount; ++s)
+                color += SampleColorBuffer.GetValue(x, y + s * height);
+            FrameBuffer.SetValue(x, y, color * weight);
+        }
+    });
+}
+
+void ForkerGL::ResolveDepthBuffer()
+{
+    ResolveDepthClears();
+    if (s_SampleCount == 1) return;
+
+    for (int y = 0; y < DepthBuffer.GetHeight(); ++y)
+    {
+        for (int x = 0; x < DepthBuffer.GetWidth(); ++x)
+            DepthBuffer.SetValue(x, y, SampleDepthBuffer.GetValue(x, y));
+    }
+    DepthHiZBuffer.Build(DepthBuffer, s_TileSize);  // nearest depths of sample 0
+}
+
+// Writes the farthest depth to the block, which is no longer flagged as cleared after
+// the next Hi-Z update
+static void WriteClearedBlock(int bx, int by)
+{
+    int blockSize = HiZBuffer::BlockSize;
+    int yMax = Min((by + 1) * blockSize, ForkerGL::DepthBuffer.GetHeight());
+    for (int y = by * blockSize; y < yMax; ++y)
+    {
+        Float* span = ForkerGL::DepthBuffer.GetSpan(bx * blockSize, y);
+        std::fill(span, span + blockSize, MaxFloat);
+    }
+}
+
+void ForkerGL::ResolveDepthClears()
+{
+    int numBlocksX = DepthHiZBuffer.GetNumBlocksX();
+    GetThreadPool().ParallelFor(DepthHiZBuffer.GetNumBlocksY(), [&](int by) {
+        for (int bx = 0; bx < numBlocksX; ++bx)
+        {
+            if (!DepthHiZBuffer.IsBlockCleared(bx, by)) continue;
+            WriteClearedBlock(bx, by);
+            DepthHiZBuffer.UpdateBlock(bx, by, DepthBuffer);
+        }
+    });
+}
+
 // BoundBox Definition
 template <typename T>
 struct BoundBox
 {
     T MinX, MinY, MaxX, MaxY;
+    BoundBox() : MinX(0), MinY(0), MaxX(0), MaxY(0) { }
     BoundBox(T minX, T minY, T maxX, T maxY)
         : MinX(minX), MinY(minY), MaxX(maxX), MaxY(maxY)
     {
     }
 
-    static BoundBox GenerateBoundBox(const Point2i points[3], T bufferWidth,
-                                     T bufferHeight)
+    bool IsEmpty() const { return MinX > MaxX || MinY > MaxY; }
+
+    BoundBox ClampToBuffer(T bufferWidth, T bufferHeight) const
     {
-        T minX = Clamp(Min3(points[0].x, points[1].x, points[2].x), 0, bufferWidth - 1);
-        T minY = Clamp(Min3(points[0].y, points[1].y, points[2].y), 0, bufferHeight - 1);
-        T maxX = Clamp(Max3(points[0].x, points[1].x, points[2].x), 0, bufferWidth - 1);
-        T maxY = Clamp(Max3(points[0].y, points[1].y, points[2].y), 0, bufferHeight - 1);
-        return BoundBox<T>(minX, minY, maxX, maxY);
+        return BoundBox<T>(Clamp(MinX, 0, bufferWidth - 1),
+                           Clamp(MinY, 0, bufferHeight - 1),
+                           Clamp(MaxX, 0, bufferWidth - 1),
+                           Clamp(MaxY, 0, bufferHeight - 1));
     }
 };
 
-void ForkerGL::DrawTriangleSubTask(int xMin, int xMax, int yMin, int yMax,
-                                   const Point2i points[3], Shader& shader,
-                                   const Point3f& depths)
+// Sub-Pixel Precision: vertices are snapped to a fixed-point grid and pixels are sampled
+// at their centers
+static const int s_SubPixelBits = 8;
+static const int s_SubPixelScale = 1 << s_SubPixelBits;
+static const int s_SubPixelHalf = s_SubPixelScale / 2;
+
+inline int ToFixedPoint(Float v)
 {
-    for (int px = xMin; px <= xMax; ++px)
+    return (int)std::floor(v * s_SubPixelScale + 0.5f);
+}
+
+// Pixels whose centers lie in the fixed-point bounding box of the vertices (may be
+// empty), or whose samples may when the box is grown by a margin in sub-pixels
+static BoundBox<int> GeneratePixelBoundBox(const Point2i points[3], int margin = 0)
+{
+    // Arithmetic shifts round towards negative infinity
+    auto ceilPixel = [margin](int v) {
+        return (v - margin - s_SubPixelHalf + s_SubPixelScale - 1) >> s_SubPixelBits;
+    };
+    auto floorPixel = [margin](int v) {
+        return (v + margin - s_SubPixelHalf) >> s_SubPixelBits;
+    };
+    return BoundBox<int>(ceilPixel(Min3(points[0].x, points[1].x, points[2].x)),
+                         ceilPixel(Min3(points[0].y, points[1].y, points[2].y)),
+                         floorPixel(Max3(points[0].x, points[1].x, points[2].x)),
+                         floorPixel(Max3(points[0].y, points[1].y, points[2].y)));
+}
+
+// Hi-Z Test: nothing at or behind the nearest depth can pass the depth test against the
+// farthest stored one (the margin covers rounding of the interpolated depths)
+static bool IsOccluded(Float nearest, Float farthest)
+{
+    const Float margin = 1e-5f;
+    return (depthFunc == ForkerGL::Less) ? nearest - margin >= farthest
+                                         : nearest - margin > farthest;
+}
+
+// Hi-Z Acceptance: everything in front of the nearest stored depth passes the less-than
+// test without reading the stored depths
+static bool IsUnoccluded(Float farthest, Float nearest)
+{
+    const Float margin = 1e-5f;
+    return depthFunc == ForkerGL::Less && farthest + margin < nearest;
+}
+
+// Edge Function: E(x, y) = A * x + B * y + C in fixed point, positive on the inner side
+struct EdgeFunction
+{
+    int64_t A, B, C;
+    int64_t bias;  // 0 for top-left edges, -1 otherwise (top-left fill rule)
+
+    EdgeFunction() : A(0), B(0), C(0), bias(0) { }
+
+    // Directed edge v0 -> v1, inner side is on the left (counter-clockwise)
+    EdgeFunction(const Point2i& v0, const Point2i& v1)
+        : A((int64_t)v0.y - v1.y),
+          B((int64_t)v1.x - v0.x),
+          C((int64_t)v0.x * v1.y - (int64_t)v0.y * v1.x),
+          bias(0)
     {
-        for (int py = yMin; py <= yMax; ++py)
+    }
+
+    int64_t Evaluate(int64_t x, int64_t y) const { return A * x + B * y + C; }
+
+    // Value at the center of pixel (px, py) and increments per pixel
+    int64_t EvaluatePixel(int px, int py) const
+    {
+        return Evaluate((int64_t)px * s_SubPixelScale + s_SubPixelHalf,
+                        (int64_t)py * s_SubPixelScale + s_SubPixelHalf);
+    }
+    int64_t StepX() const { return A * s_SubPixelScale; }
+    int64_t StepY() const { return B * s_SubPixelScale; }
+
+    // Largest biased value over a rectangle spanning w x h pixels from a corner valued e
+    int64_t MaxOverRect(int64_t e, int64_t w, int64_t h) const
+    {
+        return e + bias + Max(StepX() * w, (int64_t)0) + Max(StepY() * h, (int64_t)0);
+    }
+
+    // Same, but over the whole pixel squares (where the samples of a multisampled pixel
+    // lie) instead of the pixel centers
+    int64_t MaxOverSampleRect(int64_t e, int64_t w, int64_t h) const
+    {
+        return MaxOverRect(e - (A + B) * s_SubPixelHalf, w + 1, h + 1);
+    }
+
+    void Flip()
+    {
+        A = -A;
+        B = -B;
+        C = -C;
+    }
+
+    // Shared edges are only covered by the triangle that has them as a top or left
+    // edge (y points up in screen space)
+    void SetFillRule() { bias = (A > 0 || (A == 0 && B < 0)) ? 0 : -1; }
+};
+
+// Triangle Setup (done once per triangle)
+struct TriangleSetup
+{
+    EdgeFunction  edges[3];  // edges[i] is opposite to vertex i
+    bool          frontFacing;  // counter-clockwise on screen
+    bool          clipped;
+    Matrix3x3f    baryTransform;  // to barycentric coordinates of the unclipped triangle
+    Float         invArea;   // 1 / (2 * area)
+    Point3f       depths;
+    Float         depthStepX;  // depth increments per pixel
+    Float         depthStepY;
+    Float         minDepth;  // nearest depth (for Hi-Z rejection)
+    Float         maxDepth;  // farthest depth (for Hi-Z acceptance)
+    BoundBox<int> bbox;
+
+    // Points are in fixed point, returns false for degenerate triangles
+    static bool Setup(const Point2i points[3], const Point3f& depths,
+                      const BoundBox<int>& bbox, TriangleSetup& setup)
+    {
+        setup.edges[0] = EdgeFunction(points[1], points[2]);
+        setup.edges[1] = EdgeFunction(points[2], points[0]);
+        setup.edges[2] = EdgeFunction(points[0], points[1]);
+
+        int64_t area2 = setup.edges[0].Evaluate(points[0].x, points[0].y);
+        if (area2 == 0) return false;
+        setup.frontFacing = (area2 > 0);
+        setup.clipped = false;
+
+        // Either winding is rasterized, so make the inner sides positive
+        if (area2 < 0)
         {
-            Vector3f bary =
-                Barycentric(points[0], points[1], points[2], Vector2i(px, py));
+            for (EdgeFunction& edge : setup.edges)
+                edge.Flip();
+            area2 = -area2;
+        }
+        for (EdgeFunction& edge : setup.edges)
+            edge.SetFillRule();
 
-            // Inside Triangle Test
-            if (bary.x < 0) continue;
+        setup.invArea = 1.f / (Float)area2;
+        setup.depths = depths;
+        setup.depthStepX = (setup.edges[0].StepX() * depths[0] +
+                            setup.edges[1].StepX() * depths[1] +
+                            setup.edges[2].StepX() * depths[2]) *
+                           setup.invArea;
+        setup.depthStepY = (setup.edges[0].StepY() * depths[0] +
+                            setup.edges[1].StepY() * depths[1] +
+                            setup.edges[2].StepY() * depths[2]) *
+                           setup.invArea;
+        setup.minDepth = Min3(depths[0], depths[1], depths[2]);
+        setup.maxDepth = Max3(depths[0], depths[1], depths[2]);
+        setup.bbox = bbox;
+        return true;
+    }
+};
 
-            // Depth Test
-            Float currentDepth = Dot(bary, depths);
+// A binned triangle only references its shader, draw context and varyings, which are
+// read-only while the bins are rasterized, so all workers share them
+struct BinnedTriangle
+{
+    TriangleSetup      setup;
+    const Shader*      shader;
+    const DrawContext* context;
+    int                planeOffset;  // attribute planes in s_AttributePlanes
+    int                numVaryings;
+    int                oneOverWVarying;
+    uint32_t           visibilityId;  // written by the visibility pass
+};
 
-            if (passType == ForwardPass)
-            {
-                if (currentDepth >= DepthBuffer.GetValue(px, py)) continue;
-                DepthBuffer.SetValue(px, py, currentDepth);
-            }
-            else if (passType == GeometryPass)
-            {
-                if (currentDepth >= DepthBuffer.GetValue(px, py)) continue;
-                DepthBuffer.SetValue(px, py, currentDepth);
-            }
-            else if (passType == LightingPass)
-            {
-                // Do nothing
-            }
-            else if (passType == ShadowPass)
-            {
-                if (currentDepth >= DepthBuffer.GetValue(px, py)) continue;
-                DepthBuffer.SetValue(px, py, currentDepth);
-            }
+// Attribute Plane Equations: a varying at pixel (x, y) of a binned triangle is
+// v + dv/dx * (x - bbox.MinX) + dv/dy * (y - bbox.MinY), stored as [v..., dx..., dy...]
+static std::vector<Float> s_AttributePlanes;
 
-            // Fragment Shader
-            Color3 frag;
-            bool   discard = shader.ProcessFragment(bary, frag);
-            if (discard) continue;
+static void SetupAttributePlanes(const TriangleSetup&    setup,
+                                 const TriangleVaryings& varyings, int numVaryings,
+                                 Float* planes)
+{
+    const EdgeFunction* edges = setup.edges;
 
-            if (passType == ForwardPass)
-            {
-                FrameBuffer.SetValue(px, py, frag);
-            }
-            else if (passType == GeometryPass)
-            {
-                // Do Nothing
-                GShader& geometryShader = dynamic_cast<GShader&>(shader);
-                NormalGBuffer.SetValue(px, py, geometryShader.outNormalWS);
-                WorldPosGBuffer.SetValue(px, py, geometryShader.outPositionWS);
-                if (Shadow::GetShadowStatus())
-                    LightSpaceNDCPosGBuffer.SetValue(px, py, geometryShader.outLightSpaceNDC);
-                AlbedoGBuffer.SetValue(px, py, geometryShader.outAlbedo);
-                EmissiveGBuffer.SetValue(px, py, geometryShader.outEmissive);
-                ParamGBuffer.SetValue(px, py, geometryShader.outParam);
-                ShadingTypeGBuffer.SetValue(px, py, geometryShader.outShadingType);
-            }
-            else if (passType == LightingPass)
+    // Barycentric coordinates at the origin pixel and their screen-space gradients
+    int      x0 = setup.bbox.MinX, y0 = setup.bbox.MinY;
+    Vector3f bary = Vector3f((Float)edges[0].EvaluatePixel(x0, y0),
+                             (Float)edges[1].EvaluatePixel(x0, y0),
+                             (Float)edges[2].EvaluatePixel(x0, y0)) *
+                    setup.invArea;
+    Vector3f baryDX = Vector3f((Float)edges[0].StepX(), (Float)edges[1].StepX(),
+                               (Float)edges[2].StepX()) *
+                      setup.invArea;
+    Vector3f baryDY = Vector3f((Float)edges[0].StepY(), (Float)edges[1].StepY(),
+                               (Float)edges[2].StepY()) *
+                      setup.invArea;
+    if (setup.clipped)
+    {
+        bary = setup.baryTransform * bary;
+        baryDX = setup.baryTransform * baryDX;
+        baryDY = setup.baryTransform * baryDY;
+    }
+
+    const Float* v0 = varyings.vertices[0];
+    const Float* v1 = varyings.vertices[1];
+    const Float* v2 = varyings.vertices[2];
+    for (int k = 0; k < numVaryings; ++k)
+    {
+        planes[k] = v0[k] * bary.x + v1[k] * bary.y + v2[k] * bary.z;
+        planes[numVaryings + k] = v0[k] * baryDX.x + v1[k] * baryDX.y + v2[k] * baryDX.z;
+        planes[numVaryings * 2 + k] =
+            v0[k] * baryDY.x + v1[k] * baryDY.y + v2[k] * baryDY.z;
+    }
+}
+
+// Output Merge of the geometry pass (positions are not stored in the packed format)
+void ForkerGL::WriteGBuffers(int x, int sy, const FragmentOutput& out)
+{
+    if (s_GBufferFormat == Packed)
+    {
+        PackedGBuffers.SetValue(x, sy, out.normalWS, out.albedo, out.emissive, out.param,
+                                out.shadingType);
+        return;
+    }
+    NormalGBuffer.SetValue(x, sy, out.normalWS);
+    WorldPosGBuffer.SetValue(x, sy, out.positionWS);
+    if (Shadow::GetShadowStatus())
+        LightSpaceNDCPosGBuffer.SetValue(x, sy, out.lightSpaceNDC);
+    AlbedoGBuffer.SetValue(x, sy, out.albedo);
+    EmissiveGBuffer.SetValue(x, sy, out.emissive);
+    ParamGBuffer.SetValue(x, sy, out.param);
+    ShadingTypeGBuffer.SetValue(x, sy, out.shadingType);
+}
+
+FragmentOutput ForkerGL::ReadGBuffers(int x, int sy)
+{
+    FragmentOutput out;
+    if (s_GBufferFormat == Packed)
+    {
+        out.normalWS = PackedGBuffers.GetNormal(x, sy);
+        out.positionWS = ReadGBufferPosition(x, sy);
+        if (Shadow::GetShadowStatus())
+        {
+            Point4f lightSpaceNDC = lightSpaceMatrix * Point4f(out.positionWS, 1.f);
+            out.lightSpaceNDC = lightSpaceNDC.xyz / lightSpaceNDC.w;
+        }
+        out.albedo = PackedGBuffers.GetAlbedo(x, sy);
+        out.emissive = PackedGBuffers.GetEmissive(x, sy);
+        out.param = PackedGBuffers.GetParam(x, sy);
+        out.shadingType = PackedGBuffers.GetShadingType(x, sy);
+        return out;
+    }
+    out.normalWS = NormalGBuffer.GetValue(x, sy);
+    out.positionWS = WorldPosGBuffer.GetValue(x, sy);
+    if (Shadow::GetShadowStatus())
+        out.lightSpaceNDC = LightSpaceNDCPosGBuffer.GetValue(x, sy);
+    out.albedo = AlbedoGBuffer.GetValue(x, sy);
+    out.emissive = EmissiveGBuffer.GetValue(x, sy);
+    out.param = ParamGBuffer.GetValue(x, sy);
+    out.shadingType = ShadingTypeGBuffer.GetValue(x, sy);
+    return out;
+}
+
+// Packed format: the screen position of the pixel center (or of the sample) and its
+// depth are transformed back to world space
+Point3f ForkerGL::ReadGBufferPosition(int x, int sy)
+{
+    if (s_GBufferFormat != Packed) return WorldPosGBuffer.GetValue(x, sy);
+
+    int   height = DepthBuffer.GetHeight();
+    int   s = sy / height, y = sy % height;
+    Float sampleX = x + 0.5f, sampleY = y + 0.5f;
+    Float depth;
+    if (s_SampleCount > 1)
+    {
+        const int* position = s_SamplePositions[s_SampleCount - 1 + s];
+        sampleX += position[0] / 16.f;
+        sampleY += position[1] / 16.f;
+        depth = SampleDepthBuffer.GetValue(x, sy);
+    }
+    else
+    {
+        depth = DepthBuffer.GetValue(x, y);
+    }
+    if (depth > 1.f) return Point3f(0.f);  // background (cleared)
+
+    Point4f positionWS = s_ScreenToWorldMatrix * Point4f(sampleX, sampleY, depth, 1.f);
+    return positionWS.xyz / positionWS.w;
+}
+
+Vector3f ForkerGL::ReadGBufferNormal(int x, int sy)
+{
+    return (s_GBufferFormat == Packed) ? PackedGBuffers.GetNormal(x, sy)
+                                       : NormalGBuffer.GetValue(x, sy);
+}
+
+Float ForkerGL::ReadGBufferShadingType(int x, int sy)
+{
+    return (s_GBufferFormat == Packed) ? PackedGBuffers.GetShadingType(x, sy)
+                                       : ShadingTypeGBuffer.GetValue(x, sy);
+}
+
+// Pixel runs stay in one Hi-Z block, which is a contiguous span of the tiled depths
+static_assert(PixelLayout::Tiled::SpanWidth % HiZBuffer::BlockSize == 0,
+              "runs of a Hi-Z block must be contiguous depths");
+
+// Tested instead of the depths of cleared or accepted blocks
+static const Float s_FarthestDepths[HiZBuffer::BlockSize] = {
+    MaxFloat, MaxFloat, MaxFloat, MaxFloat, MaxFloat, MaxFloat, MaxFloat, MaxFloat
+};
+
+template <typename ShaderT, ForkerGL::PassType Pass>
+int ForkerGL::DrawTriangleSubTask(int xMin, int xMax, int yMin, int yMax,
+                                   const BinnedTriangle& triangle, const ShaderT& shader)
+{
+    const TriangleSetup& setup = triangle.setup;
+    const DrawContext&   context = *triangle.context;
+
+    // Attribute Planes
+    const int    numVaryings = triangle.numVaryings;
+    const int    oneOverWVarying = triangle.oneOverWVarying;
+    const Float* planes = s_AttributePlanes.data() + triangle.planeOffset;
+    const Float* planeDX = planes + numVaryings;
+    const Float* planeDY = planes + numVaryings * 2;
+
+    const EdgeFunction& edge0 = setup.edges[0];
+    const EdgeFunction& edge1 = setup.edges[1];
+    const EdgeFunction& edge2 = setup.edges[2];
+
+    // Edge increments per pixel
+    const int64_t stepX0 = edge0.StepX(), stepX1 = edge1.StepX(), stepX2 = edge2.StepX();
+    const int64_t stepY0 = edge0.StepY(), stepY1 = edge1.StepY(), stepY2 = edge2.StepY();
+
+    const int lanes = RasterKernel::GetLaneCount();
+    const int blockSize = HiZBuffer::BlockSize;
+
+    RasterKernel::Span span;
+    span.step[0] = (double)stepX0;
+    span.step[1] = (double)stepX1;
+    span.step[2] = (double)stepX2;
+    span.zStep = setup.depthStepX;
+
+    RasterKernel::DepthTest depthTest =
+        (depthFunc == Equal) ? RasterKernel::Equal : RasterKernel::Less;
+
+    // Multisampling: coverage & depth are tested per sample, the shadow pass stays
+    // single-sampled. Sample s of row y is row y + s * sampleRows of the sample buffers.
+    const bool     multisampled = (s_SampleCount > 1 && Pass != ShadowPass);
+    const int      numSamples = multisampled ? s_SampleCount : 1;
+    const int      sampleRows = DepthBuffer.GetHeight();
+    TiledBuffer1f& depthTarget = multisampled ? SampleDepthBuffer : DepthBuffer;
+    Buffer3f&      colorTarget = multisampled ? SampleColorBuffer : FrameBuffer;
+
+    // Edge & depth offsets of the samples from the pixel center
+    int64_t sampleEdges[s_MaxSampleCount][3];
+    Float   sampleDepths[s_MaxSampleCount];
+    for (int s = 0; s < numSamples; ++s)
+    {
+        const int* position = s_SamplePositions[numSamples - 1 + s];
+        int64_t    ox = position[0] * (s_SubPixelScale / 16);
+        int64_t    oy = position[1] * (s_SubPixelScale / 16);
+        for (int k = 0; k < 3; ++k)
+            sampleEdges[s][k] = setup.edges[k].A * ox + setup.edges[k].B * oy;
+        sampleDepths[s] =
+            (setup.depthStepX * ox + setup.depthStepY * oy) / (Float)s_SubPixelScale;
+    }
+
+    uint32_t sampleMasks[s_MaxSampleCount];
+    Float    depths[s_MaxSampleCount][8];
+    Float rowVaryings[Shader::MaxVaryings];  // at the first pixel of a block row
+    Float varyings[Shader::MaxVaryings];
+    int   fragmentCount = 0;
+
+    // Blocks are aligned to the Hi-Z grid, pixels inside a block are traversed row-major
+    for (int by = yMin / blockSize; by <= yMax / blockSize; ++by)
+    {
+        int blockMinY = Max(by * blockSize, yMin);
+        int blockMaxY = Min(by * blockSize + blockSize - 1, yMax);
+
+        for (int bx = xMin / blockSize; bx <= xMax / blockSize; ++bx)
+        {
+            int blockMinX = Max(bx * blockSize, xMin);
+            int blockMaxX = Min(bx * blockSize + blockSize - 1, xMax);
+            int blockW = blockMaxX - blockMinX;
+            int blockH = blockMaxY - blockMinY;
+
+            // Edge values at the block corner pixel, then stepped incrementally
+            int64_t rowE0 = edge0.EvaluatePixel(blockMinX, blockMinY);
+            int64_t rowE1 = edge1.EvaluatePixel(blockMinX, blockMinY);
+            int64_t rowE2 = edge2.EvaluatePixel(blockMinX, blockMinY);
+
+            // Block is completely outside of an edge
+            auto maxOverBlock = [&](const EdgeFunction& edge, int64_t e) {
+                return multisampled ? edge.MaxOverSampleRect(e, blockW, blockH)
+                                    : edge.MaxOverRect(e, blockW, blockH);
+            };
+            if (maxOverBlock(edge0, rowE0) < 0 || maxOverBlock(edge1, rowE1) < 0 ||
+                maxOverBlock(edge2, rowE2) < 0)
+                continue;
+
+            // Hi-Z: nearest depth of the triangle in the block is behind every stored one
+            Vector3f cornerBary = Vector3f((Float)rowE0, (Float)rowE1, (Float)rowE2);
+            Float    nearest = Dot(cornerBary * setup.invArea, setup.depths) +
+                            Min(setup.depthStepX * blockW, (Float)0) +
+                            Min(setup.depthStepY * blockH, (Float)0);
+            nearest = Max(nearest, setup.minDepth);
+            if (multisampled)  // samples are up to half a pixel away from the centers
+                nearest -=
+                    (std::abs(setup.depthStepX) + std::abs(setup.depthStepY)) * 0.5f;
+            if (IsOccluded(nearest, DepthHiZBuffer.GetBlockMax(bx, by))) continue;
+
+            // Cleared blocks are not in memory yet. The nearest stored depths are per
+            // pixel, so acceptance needs one sample per pixel.
+            bool cleared = DepthHiZBuffer.IsBlockCleared(bx, by);
+            bool accepted = cleared;
+            if (!cleared && !multisampled)
             {
-                // Do nothing
+                Float farthest = Dot(cornerBary * setup.invArea, setup.depths) +
+                                 Max(setup.depthStepX * blockW, (Float)0) +
+                                 Max(setup.depthStepY * blockH, (Float)0);
+                farthest = Min(farthest, setup.maxDepth);
+                accepted = IsUnoccluded(farthest, DepthHiZBuffer.GetBlockMin(bx, by));
             }
-            else if (passType == ShadowPass)
+
+            bool blockWritten = false;
+
+            for (int py = blockMinY; py <= blockMaxY; ++py)
             {
-                ShadowBuffer.SetValue(px, py, frag.z);
+                Vector3f rowBary = Vector3f((Float)rowE0, (Float)rowE1, (Float)rowE2);
+                Float    rowDepth = Dot(rowBary * setup.invArea, setup.depths);
+                bool         rowVaryingsReady = false;
+
+                int64_t e0 = rowE0, e1 = rowE1, e2 = rowE2;
+
+                // Coverage & depth test a run of pixels at once, then shade the survivors
+                for (int x = blockMinX; x <= blockMaxX; x += lanes)
+                {
+                    int count = Min(lanes, blockMaxX - x + 1);
+
+                    Float runDepth = rowDepth + (Float)(x - blockMinX) * span.zStep;
+
+                    // A pixel is shaded if any of its samples passed
+                    uint32_t mask = 0;
+                    for (int s = 0; s < numSamples; ++s)
+                    {
+                        span.e[0] = (double)(e0 + edge0.bias + sampleEdges[s][0]);
+                        span.e[1] = (double)(e1 + edge1.bias + sampleEdges[s][1]);
+                        span.e[2] = (double)(e2 + edge2.bias + sampleEdges[s][2]);
+                        span.z = runDepth + sampleDepths[s];
+
+                        const Float* depthSpan =
+                            accepted ? s_FarthestDepths
+                                     : depthTarget.GetSpan(x, py + s * sampleRows);
+                        sampleMasks[s] = RasterKernel::CoverageDepthTest(
+                            span, depthSpan, count, depthTest, depths[s]);
+                        mask |= sampleMasks[s];
+                    }
+
+                    // Masked out pixels are neither written nor counted
+                    if (s_PixelMask)
+                    {
+                        const Float* maskSpan = s_PixelMask->GetSpan(x, py);
+                        for (int i = 0; i < count; ++i)
+                        {
+                            if (maskSpan[i] == 0.f) mask &= ~(1u << i);
+                        }
+                    }
+
+                    for (int i = 0; mask != 0; ++i, mask >>= 1)
+                    {
+                        if ((mask & 1u) == 0) continue;
+                        int px = x + i;
+
+                        ++fragmentCount;
+
+                        // Depth Write (every rasterized pass tests against DepthBuffer)
+                        if (depthFunc == Less)
+                        {
+                            if (cleared && !blockWritten) WriteClearedBlock(bx, by);
+                            for (int s = 0; s < numSamples; ++s)
+                            {
+                                if ((sampleMasks[s] >> i) & 1u)
+                                    depthTarget.SetValue(px, py + s * sampleRows,
+                                                         depths[s][i]);
+                            }
+                            // Hi-Z is built from DepthBuffer: keep the farthest sample
+                            if (multisampled)
+                            {
+                                Float farthest = depthTarget.GetValue(px, py);
+                                for (int s = 1; s < numSamples; ++s)
+                                {
+                                    int sy = py + s * sampleRows;
+                                    farthest =
+                                        Max(farthest, depthTarget.GetValue(px, sy));
+                                }
+                                DepthBuffer.SetValue(px, py, farthest);
+                            }
+                            blockWritten = true;
+                        }
+                        if (Pass == DepthPrePass) continue;
+                        if (Pass == VisibilityPass)
+                        {
+                            VisibilityBuffer.SetValue(px, py, triangle.visibilityId);
+                            continue;
+                        }
+
+                        // Varyings: evaluate the planes once per row, then step along it
+                        if (!rowVaryingsReady)
+                        {
+                            Float offsetX = (Float)(blockMinX - setup.bbox.MinX);
+                            Float offsetY = (Float)(py - setup.bbox.MinY);
+                            for (int k = 0; k < numVaryings; ++k)
+                                rowVaryings[k] = planes[k] + planeDX[k] * offsetX +
+                                                 planeDY[k] * offsetY;
+                            rowVaryingsReady = true;
+                        }
+                        Float dx = (Float)(px - blockMinX);
+                        for (int k = 0; k < numVaryings; ++k)
+                            varyings[k] = rowVaryings[k] + planeDX[k] * dx;
+
+                        // PCI
+                        if (oneOverWVarying >= 0)
+                        {
+                            Float w = 1.f / varyings[oneOverWVarying];
+                            for (int k = 0; k < numVaryings; ++k)
+                                varyings[k] *= w;
+                        }
+
+                        // Fragment Shader (a direct call unless ShaderT is Shader)
+                        FragmentOutput out;
+                        SeedRandom(px, py);
+                        bool discard = shader.ProcessFragment(context, varyings, out);
+                        if (discard) continue;
+
+                        // Output Merge to the covered samples (LightingPass writes
+                        // nothing)
+                        for (int s = 0; s < numSamples; ++s)
+                        {
+                            if (((sampleMasks[s] >> i) & 1u) == 0) continue;
+                            int sy = py + s * sampleRows;
+                            if (Pass == ForwardPass)
+                                colorTarget.SetValue(px, sy, out.color);
+                            else if (Pass == GeometryPass)
+                                WriteGBuffers(px, sy, out);
+                            else if (Pass == ShadowPass)
+                                ShadowBuffer.SetValue(px, py, out.color.z);
+                        }
+                    }
+
+                    e0 += lanes * stepX0;
+                    e1 += lanes * stepX1;
+                    e2 += lanes * stepX2;
+                }
+
+                rowE0 += stepY0;
+                rowE1 += stepY1;
+                rowE2 += stepY2;
             }
+
+            if (blockWritten) DepthHiZBuffer.UpdateBlock(bx, by, DepthBuffer);
         }
     }
+
+    return fragmentCount;
 }
 
-#define NUM_THREADS 4
+int ForkerGL::DispatchTriangleSubTask(int xMin, int xMax, int yMin, int yMax,
+                                       const BinnedTriangle& triangle)
+{
+    // Built-in shaders are final, so comparing the exact type is enough
+    const Shader&         shader = *triangle.shader;
+    const std::type_info& type = typeid(shader);
+
+    switch (passType)
+    {
+        case DepthPrePass:  // no fragment shading
+            return DrawTriangleSubTask<Shader, DepthPrePass>(xMin, xMax, yMin, yMax,
+                                                             triangle, shader);
+        case VisibilityPass:
+            return DrawTriangleSubTask<Shader, VisibilityPass>(xMin, xMax, yMin, yMax,
+                                                               triangle, shader);
+        case ShadowPass:
+            if (type == typeid(DepthShader))
+                return DrawTriangleSubTask<DepthShader, ShadowPass>(
+                    xMin, xMax, yMin, yMax, triangle,
+                    static_cast<const DepthShader&>(shader));
+            return DrawTriangleSubTask<Shader, ShadowPass>(xMin, xMax, yMin, yMax,
+                                                           triangle, shader);
+        case GeometryPass:
+            if (type == typeid(GShader))
+                return DrawTriangleSubTask<GShader, GeometryPass>(
+                    xMin, xMax, yMin, yMax, triangle,
+                    static_cast<const GShader&>(shader));
+            return DrawTriangleSubTask<Shader, GeometryPass>(xMin, xMax, yMin, yMax,
+                                                             triangle, shader);
+        case ForwardPass:
+            if (type == typeid(BlinnPhongShader))
+                return DrawTriangleSubTask<BlinnPhongShader, ForwardPass>(
+                    xMin, xMax, yMin, yMax, triangle,
+                    static_cast<const BlinnPhongShader&>(shader));
+            if (type == typeid(PBRShader))
+                return DrawTriangleSubTask<PBRShader, ForwardPass>(
+                    xMin, xMax, yMin, yMax, triangle,
+                    static_cast<const PBRShader&>(shader));
+            return DrawTriangleSubTask<Shader, ForwardPass>(xMin, xMax, yMin, yMax,
+                                                            triangle, shader);
+        default:
+            return DrawTriangleSubTask<Shader, LightingPass>(xMin, xMax, yMin, yMax,
+                                                             triangle, shader);
+    }
+}
+
+// Tile Binning (sort-middle): triangles are binned into screen tiles after vertex
+// processing and each tile is rasterized by exactly one worker, so every tile owns its
+// depth/color pixels and no locks are needed.
+static std::vector<BinnedTriangle>   s_BinnedTriangles;
+static std::vector<std::vector<int>> s_TileBins;  // triangle indices of each tile
+static int                           s_NumTilesX = 0;
+static int                           s_NumTilesY = 0;
+
+// Frustum Culling: all vertices are outside of the same clip plane (-w <= x, y, z <= w)
+static bool IsOutsideFrustum(const Point4f clipVerts[3])
+{
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        bool allBelow = true, allAbove = true;
+        for (int i = 0; i < 3; ++i)
+        {
+            allBelow = allBelow && clipVerts[i][axis] < -clipVerts[i].w;
+            allAbove = allAbove && clipVerts[i][axis] > clipVerts[i].w;
+        }
+        if (allBelow || allAbove) return true;
+    }
+    return false;
+}
+
+// Clipping Planes (inside if a * x + b * y + c * z + d * w >= 0): the near plane, plus
+// guard band planes far outside the viewport that keep screen coordinates in range.
+// The other frustum planes are handled by the bounding box clamp.
+static const Float s_GuardBand = 16.f;  // in NDC units
+static const int   s_NumClipPlanes = 5;
+static const Float s_ClipPlanes[s_NumClipPlanes][4] = {
+    { 0.f, 0.f, 1.f, 1.f },           // near: z >= -w
+    { -1.f, 0.f, 0.f, s_GuardBand },  // x <= G * w
+    { 1.f, 0.f, 0.f, s_GuardBand },   // x >= -G * w
+    { 0.f, -1.f, 0.f, s_GuardBand },  // y <= G * w
+    { 0.f, 1.f, 0.f, s_GuardBand }    // y >= -G * w
+};
+
+static Float ClipDistance(const Point4f& p, int plane)
+{
+    const Float* c = s_ClipPlanes[plane];
+    return c[0] * p.x + c[1] * p.y + c[2] * p.z + c[3] * p.w;
+}
+
+struct ClipVertex
+{
+    Point4f  position;
+    Vector3f weights;  // clip-space weights of the original triangle vertices
+};
+
+// Sutherland-Hodgman clipping of a convex polygon against one plane
+static int ClipPolygon(const ClipVertex* in, int count, int plane, ClipVertex* out)
+{
+    int outCount = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        const ClipVertex& v0 = in[i];
+        const ClipVertex& v1 = in[(i + 1) % count];
+        Float             d0 = ClipDistance(v0.position, plane);
+        Float             d1 = ClipDistance(v1.position, plane);
+
+        if (d0 >= 0.f) out[outCount++] = v0;
+        if ((d0 >= 0.f) != (d1 >= 0.f))  // crossing
+        {
+            Float t = d0 / (d0 - d1);
+            out[outCount++] = { v0.position + (v1.position - v0.position) * t,
+                                v0.weights + (v1.weights - v0.weights) * t };
+        }
+    }
+    return outCount;
+}
 
 // Rasterization
-void ForkerGL::DrawTriangle(const Point4f ndcVerts[3], Shader& shader)
+void ForkerGL::DrawTriangle(const Point4f clipVerts[3], const TriangleVaryings& varyings,
+                            const DrawContext& context, const Shader& shader, int faceIdx)
+{
+    ++s_TriangleStats.submitted;
+
+    if (IsOutsideFrustum(clipVerts))
+    {
+        ++s_TriangleStats.frustumCulled;
+        return;
+    }
+
+    // Planes crossed by the triangle
+    int planeMask = 0;
+    for (int plane = 0; plane < s_NumClipPlanes; ++plane)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            if (ClipDistance(clipVerts[i], plane) < 0.f) planeMask |= 1 << plane;
+        }
+    }
+
+    if (planeMask == 0)
+    {
+        BinTriangle(clipVerts, nullptr, varyings, context, shader, faceIdx);
+        return;
+    }
+
+    // Clipping (each plane adds at most one vertex)
+    ++s_TriangleStats.clipped;
+
+    ClipVertex polygon[3 + s_NumClipPlanes];
+    ClipVertex clippedPolygon[3 + s_NumClipPlanes];
+    int        count = 3;
+    for (int i = 0; i < 3; ++i)
+    {
+        Vector3f weights;
+        weights[i] = 1.f;
+        polygon[i] = { clipVerts[i], weights };
+    }
+
+    for (int plane = 0; plane < s_NumClipPlanes && count >= 3; ++plane)
+    {
+        if ((planeMask & (1 << plane)) == 0) continue;
+        count = ClipPolygon(polygon, count, plane, clippedPolygon);
+        std::copy(clippedPolygon, clippedPolygon + count, polygon);
+    }
+
+    // Triangle fan. Shaders interpolate the varyings of the original vertices, so the
+    // screen-space barycentric coordinates of each new triangle are mapped back:
+    // b = diag(w) * weights^T * diag(1 / w') * b' (already sums to 1)
+    for (int k = 1; k + 1 < count; ++k)
+    {
+        const ClipVertex* verts[3] = { &polygon[0], &polygon[k], &polygon[k + 1] };
+
+        Point4f    subClipVerts[3];
+        Matrix3x3f baryTransform;
+        for (int j = 0; j < 3; ++j)
+        {
+            subClipVerts[j] = verts[j]->position;
+            for (int i = 0; i < 3; ++i)
+            {
+                baryTransform[i][j] =
+                    clipVerts[i].w * verts[j]->weights[i] / verts[j]->position.w;
+            }
+        }
+        BinTriangle(subClipVerts, &baryTransform, varyings, context, shader, faceIdx);
+    }
+}
+
+void ForkerGL::BinTriangle(const Point4f clipVerts[3], const Matrix3x3f* baryTransform,
+                           const TriangleVaryings& varyings, const DrawContext& context,
+                           const Shader& shader, int faceIdx)
 {
-    // Viewport transformation
-    Point2i points[3];  // screen coordinates
+    // Perspective division & viewport transformation, snapped to sub-pixels
+    Point2i points[3];  // screen coordinates in fixed point
     Point3f depths;     // from 0 to 1
     for (int i = 0; i < 3; ++i)
     {
-        Point3f coord = (viewportMatrix * ndcVerts[i]).xyz;
-        points[i] = Point2i(coord.x, coord.y);
+        Point4f ndcVert = clipVerts[i] / clipVerts[i].w;
+        Point3f coord = (viewportMatrix * ndcVert).xyz;
+        points[i] = Point2i(ToFixedPoint(coord.x), ToFixedPoint(coord.y));
         depths[i] = coord.z;
     }
 
@@ -254,129 +1177,672 @@ void ForkerGL::DrawTriangle(const Point4f ndcVerts[3], Shader& shader)
     int w = (passType != ShadowPass) ? DepthBuffer.GetWidth() : ShadowBuffer.GetWidth();
     int h = (passType != ShadowPass) ? DepthBuffer.GetHeight() : ShadowBuffer.GetHeight();
 
-    BoundBox<int> bbox = BoundBox<int>::GenerateBoundBox(points, w, h);
+    bool          multisampled = (s_SampleCount > 1 && passType != ShadowPass);
+    BoundBox<int> bbox = GeneratePixelBoundBox(points, multisampled ? s_SubPixelHalf : 0);
 
-    if (true)  // single thread
+    // Completely off screen
+    if (bbox.MaxX < 0 || bbox.MaxY < 0 || bbox.MinX >= w || bbox.MinY >= h)
     {
-        DrawTriangleSubTask(bbox.MinX, bbox.MaxX, bbox.MinY, bbox.MaxY, points, shader,
-                            depths);
+        ++s_TriangleStats.frustumCulled;
+        return;
     }
-    else
+
+    // Zero area, or no pixel center between the vertices
+    if (bbox.IsEmpty())
     {
-        int numTasks = bbox.MaxY - bbox.MinY + 1;
+        ++s_TriangleStats.degenerate;
+        return;
+    }
+    bbox = bbox.ClampToBuffer(w, h);
 
-        if (numTasks < 5)
+    TriangleSetup setup;
+    if (!TriangleSetup::Setup(points, depths, bbox, setup))
+    {
+        ++s_TriangleStats.degenerate;
+        return;
+    }
+
+    if (baryTransform)
+    {
+        setup.clipped = true;
+        setup.baryTransform = *baryTransform;
+    }
+
+    // Face Culling
+    CullMode cullMode = cullModes[passType];
+    if ((cullMode == CullBack && !setup.frontFacing) ||
+        (cullMode == CullFront && setup.frontFacing))
+    {
+        ++s_TriangleStats.faceCulled;
+        return;
+    }
+
+    // Attribute Planes (not needed without fragment shading)
+    bool shaded = (passType != DepthPrePass && passType != VisibilityPass);
+    int  numVaryings = shaded ? shader.GetVaryingCount() : 0;
+    uint32_t visibilityId = ((uint32_t)context.drawId << s_VisibilityFaceBits) | faceIdx;
+
+    // Sort-Last: no tiles, any worker may rasterize the triangle
+    if (passType == VisibilityPass && s_SortLast)
+    {
+        s_BinnedTriangles.push_back(
+            { setup, &shader, &context, 0, numVaryings, -1, visibilityId });
+        return;
+    }
+
+    // Tile Grid
+    int tileSize = s_TileSize;
+    int numTilesX = (w + tileSize - 1) / tileSize;
+    int numTilesY = (h + tileSize - 1) / tileSize;
+    if (numTilesX != s_NumTilesX || numTilesY != s_NumTilesY)
+    {
+        Flush();  // buffer size changed in the middle of a draw
+        s_NumTilesX = numTilesX;
+        s_NumTilesY = numTilesY;
+        s_TileBins.resize(numTilesX * numTilesY);
+    }
+
+    // Hi-Z: stored depths only get nearer while triangles wait in the bins, so tiles
+    // that are already occluded can be skipped here
+    int  triangleIdx = (int)s_BinnedTriangles.size();
+    bool binned = false;
+
+    for (int ty = bbox.MinY / tileSize; ty <= bbox.MaxY / tileSize; ++ty)
+    {
+        for (int tx = bbox.MinX / tileSize; tx <= bbox.MaxX / tileSize; ++tx)
         {
-            DrawTriangleSubTask(bbox.MinX, bbox.MaxX, bbox.MinY, bbox.MaxY, points,
-                                shader, depths);
+            if (IsOccluded(setup.minDepth, DepthHiZBuffer.GetTileMax(tx, ty))) continue;
+            s_TileBins[tx + ty * numTilesX].push_back(triangleIdx);
+            binned = true;
         }
-        else
+    }
+
+    if (!binned) return;
+
+    assert(numVaryings <= Shader::MaxVaryings);
+    int planeOffset = (int)s_AttributePlanes.size();
+    s_AttributePlanes.resize(planeOffset + numVaryings * 3);
+    SetupAttributePlanes(setup, varyings, numVaryings,
+                         s_AttributePlanes.data() + planeOffset);
+
+    s_BinnedTriangles.push_back({ setup, &shader, &context, planeOffset, numVaryings,
+                                  shader.GetOneOverWVarying(), visibilityId });
+}
+
+// Sort-Last Rasterization of the visibility pass: every pixel of the triangle is written
+// to the packed depth & id buffer by an atomic minimum, so triangles can be rasterized
+// by any thread in any order (no Hi-Z, which needs owned tiles)
+static const int s_SortLastBatchSize = 64;  // triangles per job
+
+static int RasterizeSortLast(const BinnedTriangle& triangle)
+{
+    const TriangleSetup& setup = triangle.setup;
+    const BoundBox<int>& bbox = setup.bbox;
+    const EdgeFunction&  edge0 = setup.edges[0];
+    const EdgeFunction&  edge1 = setup.edges[1];
+    const EdgeFunction&  edge2 = setup.edges[2];
+
+    int64_t rowE0 = edge0.EvaluatePixel(bbox.MinX, bbox.MinY);
+    int64_t rowE1 = edge1.EvaluatePixel(bbox.MinX, bbox.MinY);
+    int64_t rowE2 = edge2.EvaluatePixel(bbox.MinX, bbox.MinY);
+    int     fragmentCount = 0;
+
+    for (int py = bbox.MinY; py <= bbox.MaxY; ++py)
+    {
+        Vector3f rowBary = Vector3f((Float)rowE0, (Float)rowE1, (Float)rowE2);
+        Float    rowDepth = Dot(rowBary * setup.invArea, setup.depths);
+
+        int64_t e0 = rowE0 + edge0.bias, e1 = rowE1 + edge1.bias, e2 = rowE2 + edge2.bias;
+        for (int px = bbox.MinX; px <= bbox.MaxX; ++px)
         {
-            std::thread drawThreads[NUM_THREADS];
-
-            int numTaskPerThread = std::round(numTasks / (Float)NUM_THREADS);
-
-
-
-            // allocated threads
-            // int numAllocatedThreads = 0;
-            //
-            // for (int t = 0; t < NUM_THREADS; ++t)
-            // {
-            //     int xStart = Max(bbox.MinX + t * numTaskPerThread, bbox.MinX);
-            //     int xEnd = Min(xStart + numTaskPerThread - 1, bbox.MaxX);
-            //
-            //     drawThreads[t] = std::thread(DrawTriangleSubTask, xStart, xEnd, bbox.MinY, bbox.MaxY, std::ref(points), std::ref(shader), std::ref(depths));
-            //     ++numAllocatedThreads;
-            //
-            //     if (xEnd == bbox.MaxX)
-            //     {
-            //         break;
-            //     }
-            // }
-            //
-            // for (int t = 0; t < numAllocatedThreads; ++t)
-            // {
-            //     drawThreads[t].join();
-            // }
-
-            int start = bbox.MinX;
-            int end = bbox.MaxX;
-
-            drawThreads[0] = std::thread(DrawTriangleSubTask, start, end / NUM_THREADS, bbox.MinY, bbox.MaxY, std::ref(points), std::ref(shader), std::ref(depths));
-
-            drawThreads[1] = std::thread(DrawTriangleSubTask, end / NUM_THREADS + 1, end / NUM_THREADS * 2, bbox.MinY, bbox.MaxY, std::ref(points), std::ref(shader), std::ref(depths));
-
-            drawThreads[2] = std::thread(DrawTriangleSubTask, end / NUM_THREADS * 2 + 1, end / NUM_THREADS * 3, bbox.MinY, bbox.MaxY, std::ref(points), std::ref(shader), std::ref(depths));
-
-            drawThreads[3] = std::thread(DrawTriangleSubTask, end / NUM_THREADS * 3 + 1, end, bbox.MinY, bbox.MaxY, std::ref(points), std::ref(shader), std::ref(depths));
-
-            drawThreads[0].join();
-            drawThreads[1].join();
-            drawThreads[2].join();
-            drawThreads[3].join();
-
-            // Join
-            // for (int t = 0; t < NUM_THREADS; ++t)
-            // {
-            //     drawThreads[t].join();
-            // }
+            bool covered = (e0 | e1 | e2) >= 0;  // no sign bit set
+            if (covered && (!s_PixelMask || s_PixelMask->GetValue(px, py) != 0.f))
+            {
+                Float depth = rowDepth + (Float)(px - bbox.MinX) * setup.depthStepX;
+                fragmentCount += ForkerGL::VisibilityDepthBuffer.TestAndSet(
+                    px, py, depth, triangle.visibilityId);
+            }
+            e0 += edge0.StepX();
+            e1 += edge1.StepX();
+            e2 += edge2.StepX();
         }
+
+        rowE0 += edge0.StepY();
+        rowE1 += edge1.StepY();
+        rowE2 += edge2.StepY();
     }
+    return fragmentCount;
 }
 
-void ForkerGL::DrawScreenSpacePixels(const Scene& scene)
+void ForkerGL::ResolveVisibilityBuffer()
 {
-    // Data Preparation
-    Point3f eyePos = scene.GetCamera().GetPosition();
-    Point3f lightPos = scene.GetPointLight().position;
-    Color3  lightRadiance = scene.GetPointLight().color;
-    int     screenWidth = ForkerGL::FrameBuffer.GetWidth();
-    int     screenHeight = ForkerGL::FrameBuffer.GetHeight();
+    if (VisibilityDepthBuffer.GetWidth() == 0) return;
 
-    // For Loop Each Pixel
-    for (int y = 0; y < screenHeight; ++y)
+    int width = VisibilityBuffer.GetWidth();
+    GetThreadPool().ParallelFor(VisibilityBuffer.GetHeight(), [&](int y) {
+        for (int x = 0; x < width; ++x)
+        {
+            DepthBuffer.SetValue(x, y, VisibilityDepthBuffer.GetDepth(x, y));
+            VisibilityBuffer.SetValue(x, y, VisibilityDepthBuffer.GetPayload(x, y));
+        }
+    });
+    DepthHiZBuffer.Build(DepthBuffer, s_TileSize);
+}
+
+void ForkerGL::Flush()
+{
+    if (s_BinnedTriangles.empty()) return;
+
+    if (passType == VisibilityPass && s_SortLast)
     {
-        for (int x = 0; x < screenWidth; ++x)
+        int numTriangles = (int)s_BinnedTriangles.size();
+        int numBatches = (numTriangles + s_SortLastBatchSize - 1) / s_SortLastBatchSize;
+        GetThreadPool().ParallelFor(numBatches, [&](int batch) {
+            int       end = Min((batch + 1) * s_SortLastBatchSize, numTriangles);
+            long long batchFragmentCount = 0;
+            for (int i = batch * s_SortLastBatchSize; i < end; ++i)
+                batchFragmentCount += RasterizeSortLast(s_BinnedTriangles[i]);
+            s_FragmentCount += batchFragmentCount;
+        });
+        s_BinnedTriangles.clear();
+        return;
+    }
+
+    std::vector<int> activeTiles;
+    for (int t = 0; t < (int)s_TileBins.size(); ++t)
+    {
+        if (!s_TileBins[t].empty()) activeTiles.push_back(t);
+    }
+
+    int tileSize = s_TileSize;
+
+    GetThreadPool().ParallelFor((int)activeTiles.size(), [&](int i) {
+        int tile = activeTiles[i];
+        int tileX = tile % s_NumTilesX;
+        int tileY = tile / s_NumTilesX;
+        int tileMinX = tileX * tileSize;
+        int tileMinY = tileY * tileSize;
+
+        long long tileFragmentCount = 0;
+
+        // Triangles are processed in submission order within each tile
+        for (int triangleIdx : s_TileBins[tile])
+        {
+            const BinnedTriangle& triangle = s_BinnedTriangles[triangleIdx];
+            const BoundBox<int>&  bbox = triangle.setup.bbox;
+
+            // Hi-Z: the tile got occluded by earlier triangles
+            Float tileFarthest = DepthHiZBuffer.GetTileMax(tileX, tileY);
+            if (IsOccluded(triangle.setup.minDepth, tileFarthest)) continue;
+
+            int fragmentCount = DispatchTriangleSubTask(
+                Max(bbox.MinX, tileMinX), Min(bbox.MaxX, tileMinX + tileSize - 1),
+                Max(bbox.MinY, tileMinY), Min(bbox.MaxY, tileMinY + tileSize - 1),
+                triangle);
+
+            if (fragmentCount > 0 && depthFunc == Less)
+                DepthHiZBuffer.UpdateTile(tileX, tileY);
+            tileFragmentCount += fragmentCount;
+        }
+        s_FragmentCount += tileFragmentCount;
+    });
+
+    // Keep the capacity for the next draw
+    for (int tile : activeTiles)
+    {
+        s_TileBins[tile].clear();
+    }
+    s_BinnedTriangles.clear();
+    s_AttributePlanes.clear();
+}
+
+void ForkerGL::RecordDraw(DrawContext& context, const Shader& shader)
+{
+    if (passType != VisibilityPass) return;
+
+    CHECK_LT((int)s_VisibilityDraws.size(), s_MaxVisibilityDraws);
+    CHECK_LE(context.mesh->NumFaces(), (int)s_VisibilityFaceMask);
+    context.drawId = (int)s_VisibilityDraws.size();
+    s_VisibilityDraws.push_back({ context, &shader });
+}
+
+// A visible triangle rebuilt from its draw record: the vertex shader runs again for
+// its three vertices. The screen-space barycentric coordinates at an NDC point p are
+// diag(w) * inverse([x y w] of the clip vertices) * (p, 1), which also holds for
+// triangles that were clipped.
+struct VisibilityTriangle
+{
+    Float      varyings[3][Shader::MaxVaryings];
+    Matrix3x3f baryMatrix;
+    int        numVaryings;
+    int        oneOverWVarying;
+
+    void Setup(const VisibilityDraw& draw, int faceIdx)
+    {
+        const Shader& shader = *draw.shader;
+        numVaryings = shader.GetVaryingCount();
+        oneOverWVarying = shader.GetOneOverWVarying();
+
+        Point4f    clipVerts[3];
+        Matrix3x3f vertMatrix;
+        for (int v = 0; v < 3; ++v)
+        {
+            clipVerts[v] = shader.ProcessVertex(draw.context, faceIdx, v, varyings[v]);
+            const Point4f& p = clipVerts[v];
+            vertMatrix.SetCol(v, Vector3f(p.x, p.y, p.w));
+        }
+        baryMatrix = vertMatrix.Inverse();
+        for (int v = 0; v < 3; ++v)
+        {
+            for (int j = 0; j < 3; ++j)
+                baryMatrix[v][j] *= clipVerts[v].w;
+        }
+    }
+
+    // Same interpolation as the attribute planes of the rasterizer
+    void Interpolate(Float ndcX, Float ndcY, Float* out) const
+    {
+        Vector3f bary = baryMatrix * Vector3f(ndcX, ndcY, 1.f);
+        for (int k = 0; k < numVaryings; ++k)
+            out[k] = varyings[0][k] * bary.x + varyings[1][k] * bary.y +
+                     varyings[2][k] * bary.z;
+
+        // PCI
+        if (oneOverWVarying >= 0)
         {
-            // Data Preparation
-            Point3f  positionWS = ForkerGL::WorldPosGBuffer.GetValue(x, y);
-            Vector3f normalWS = ForkerGL::NormalGBuffer.GetValue(x, y);
-            Point3f  lightSpaceNDC = ForkerGL::LightSpaceNDCPosGBuffer.GetValue(x, y);
-            Color3   albedo = ForkerGL::AlbedoGBuffer.GetValue(x, y);
-            Color3   emissive = ForkerGL::EmissiveGBuffer.GetValue(x, y);
-            Vector3f param = ForkerGL::ParamGBuffer.GetValue(x, y);
-            Float    shadingType = ForkerGL::ShadingTypeGBuffer.GetValue(x, y);
-
-            Float    ambientOcclusion = ForkerGL::AmbientOcclusionGBuffer.GetValue(x, y);
-            param.x *= ambientOcclusion;
-            // param.x = ambientOcclusion;
-
-
-            // Directions
-            Vector3f lightDir = Normalize(lightPos - positionWS);
-            Vector3f viewDir = Normalize(eyePos - positionWS);
-
-            // Shadow Mapping
-            Float visibility = 0.f;
-            if (Shadow::GetShadowStatus())
+            Float w = 1.f / out[oneOverWVarying];
+            for (int k = 0; k < numVaryings; ++k)
+                out[k] *= w;
+        }
+    }
+};
+
+void ForkerGL::ShadeVisibilityBuffer()
+{
+    int        width = VisibilityBuffer.GetWidth();
+    int        height = VisibilityBuffer.GetHeight();
+    Matrix4x4f screenToNDC = viewportMatrix.Inverse();
+
+    // Rows are independent jobs, neighboring pixels mostly share their triangle
+    GetThreadPool().ParallelFor(height, [&](int y) {
+        VisibilityTriangle triangle;
+        uint32_t           triangleId = s_InvalidVisibilityId;
+        Float              varyings[Shader::MaxVaryings];
+        long long          shadedCount = 0;
+
+        for (int x = 0; x < width; ++x)
+        {
+            uint32_t id = VisibilityBuffer.GetValue(x, y);
+            if (id == s_InvalidVisibilityId) continue;
+            if (s_PixelMask && s_PixelMask->GetValue(x, y) == 0.f) continue;
+
+            const VisibilityDraw& draw = s_VisibilityDraws[id >> s_VisibilityFaceBits];
+            if (id != triangleId)
             {
-                visibility = Shadow::CalculateShadowVisibility(
-                    ForkerGL::ShadowBuffer, lightSpaceNDC, normalWS, lightDir);
+                triangle.Setup(draw, (int)(id & s_VisibilityFaceMask));
+                triangleId = id;
             }
 
-            Color3 color;
-            if (shadingType < 0.5f)  // Non-PBR (Blinn-Phong Shading)
+            // Pixel center
+            Point4f ndc = screenToNDC * Point4f(x + 0.5f, y + 0.5f, 0.f, 1.f);
+            triangle.Interpolate(ndc.x, ndc.y, varyings);
+
+            FragmentOutput out;
+            SeedRandom(x, y);
+            if (draw.shader->ProcessFragment(draw.context, varyings, out)) continue;
+            FrameBuffer.SetValue(x, y, out.color);
+            ++shadedCount;
+        }
+        s_FragmentCount += shadedCount;
+    });
+}
+
+// Tiled Lighting: point lights other than the shadowed one are culled once per tile
+// against the world-space bounds of the tile's covered G-buffer texels
+static const int                     s_LightTileSize = 16;
+static std::vector<std::vector<int>> s_TileLights;  // light indices of each tile
+static std::atomic<long long>        s_LightEvaluations(0);
+
+static bool ComputeTileBounds(int tileX, int tileY, int width, int height,
+                              Point3f& boundsMin, Point3f& boundsMax)
+{
+    bool covered = false;
+    int  xEnd = Min((tileX + 1) * s_LightTileSize, width);
+    int  yEnd = Min((tileY + 1) * s_LightTileSize, height);
+    for (int y = tileY * s_LightTileSize; y < yEnd; ++y)
+    {
+        for (int x = tileX * s_LightTileSize; x < xEnd; ++x)
+        {
+            for (int s = 0; s < s_SampleCount; ++s)
             {
-                color = BlinnPhongShader::CalculateLight(lightDir, viewDir, normalWS, visibility, albedo, emissive, param, lightRadiance);
+                int   sy = y + s * height;
+                Float depth = (s_SampleCount > 1)
+                                  ? ForkerGL::SampleDepthBuffer.GetValue(x, sy)
+                                  : ForkerGL::DepthBuffer.GetValue(x, y);
+                if (depth > 1.f) continue;  // background
+
+                Point3f position = ForkerGL::ReadGBufferPosition(x, sy);
+                if (!covered)
+                {
+                    boundsMin = boundsMax = position;
+                    covered = true;
+                    continue;
+                }
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    boundsMin[axis] = Min(boundsMin[axis], position[axis]);
+                    boundsMax[axis] = Max(boundsMax[axis], position[axis]);
+                }
             }
-            else  // PBR
+        }
+    }
+    return covered;
+}
+
+// Sphere & box overlap (lights without a radius reach everything)
+static bool LightReachesBounds(const PointLight& light, const Point3f& boundsMin,
+                               const Point3f& boundsMax)
+{
+    if (light.radius <= 0.f) return true;
+    Float distanceSquared = 0.f;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        Float closest = Clamp(light.position[axis], boundsMin[axis], boundsMax[axis]);
+        Float delta = light.position[axis] - closest;
+        distanceSquared += delta * delta;
+    }
+    return distanceSquared < light.radius * light.radius;
+}
+
+static void BuildTileLightLists(const std::vector<PointLight>& lights, int width,
+                                int height)
+{
+    int numTilesX = (width + s_LightTileSize - 1) / s_LightTileSize;
+    int numTilesY = (height + s_LightTileSize - 1) / s_LightTileSize;
+    s_TileLights.resize(numTilesX * numTilesY);
+
+    ForkerGL::GetThreadPool().ParallelFor(numTilesX * numTilesY, [&](int tile) {
+        std::vector<int>& tileLights = s_TileLights[tile];
+        tileLights.clear();
+
+        Point3f boundsMin, boundsMax;
+        if (lights.size() <= 1 || !ComputeTileBounds(tile % numTilesX, tile / numTilesX,
+                                                     width, height, boundsMin, boundsMax))
+            return;
+        for (int i = 1; i < (int)lights.size(); ++i)
+        {
+            if (LightReachesBounds(lights[i], boundsMin, boundsMax))
+                tileLights.push_back(i);
+        }
+    });
+}
+
+// A G-buffer texel to light and its weight in the final pixel
+struct LightingTexel
+{
+    int   x;
+    int   sy;  // row in the G-buffers (sample plane included)
+    Float ambientOcclusion;
+    Float weight;
+};
+
+// Inputs of the lighting kernels, and the terms added to their output per texel
+struct LightingBatch
+{
+    LightingKernel::Batch kernel;
+    Color3                emissive[LightingKernel::BatchSize];
+    Color3                otherRadiance[LightingKernel::BatchSize];
+    Float                 direct[3][LightingKernel::BatchSize];  // kernel output
+};
+
+// Fills one lane with a G-buffer texel of a known shading model: the shadowed light
+// (lights[0]) goes through the kernel, the other lights of its tile are added here
+template <bool PBR>
+static void PrepareLightingLane(const LightingTexel& texel, const Point3f& eyePos,
+                                const std::vector<PointLight>& lights,
+                                const std::vector<int>& tileLights, LightingBatch& batch,
+                                int lane)
+{
+    LightingKernel::Batch& kernel = batch.kernel;
+
+    // Data Preparation
+    FragmentOutput gbuffer = ForkerGL::ReadGBuffers(texel.x, texel.sy);
+    Point3f        positionWS = gbuffer.positionWS;
+    Vector3f       normalWS = gbuffer.normalWS;
+    Color3         albedoLinear = Pow(gbuffer.albedo, Gamma);
+    Vector3f       param = gbuffer.param;
+
+    param.x *= texel.ambientOcclusion;
+
+    // Directions
+    const PointLight& light = lights[0];
+    Vector3f          lightDir = Normalize(light.position - positionWS);
+    Vector3f          viewDir = Normalize(eyePos - positionWS);
+    Color3            lightRadiance =
+        light.color * light.Attenuation((light.position - positionWS).Length());
+
+    // Shadow Mapping
+    Float shadowScale = 1.f;
+    if (Shadow::GetShadowStatus())
+    {
+        SeedRandom(texel.x, texel.sy);
+        Float visibility = Shadow::CalculateShadowVisibility(
+            ForkerGL::ShadowBuffer, gbuffer.lightSpaceNDC, normalWS, lightDir);
+        Float shadowIntensity = 0.6f;
+        shadowScale = 1 - (1 - visibility) * shadowIntensity;
+    }
+
+    // Other Lights (unshadowed, linear space)
+    Color3 otherRadiance(0.f);
+    if (!tileLights.empty())
+    {
+        for (int index : tileLights)
+        {
+            const PointLight& other = lights[index];
+            Vector3f          toLight = other.position - positionWS;
+            Float             distance = toLight.Length();
+            Float             attenuation = other.Attenuation(distance);
+            if (attenuation <= 0.f || distance <= 0.f) continue;
+
+            Vector3f otherDir = toLight / distance;
+            Vector3f otherHalfwayDir = Normalize(otherDir + viewDir);
+            Color3   radiance = other.color * attenuation;
+            if (PBR)
+                otherRadiance += PBRShader::CalculateRadiance(
+                    otherDir, viewDir, otherHalfwayDir, normalWS, albedoLinear, param,
+                    radiance);
+            else
+                otherRadiance += BlinnPhongShader::CalculateRadiance(
+                    otherDir, otherHalfwayDir, normalWS, albedoLinear, param, radiance);
+        }
+        s_LightEvaluations += (long long)tileLights.size();
+    }
+
+    // Blinn-Phong is lit with the view direction in place of the halfway one, as the
+    // deferred path always did
+    Vector3f halfwayDir = PBR ? Normalize(lightDir + viewDir) : viewDir;
+    for (int k = 0; k < 3; ++k)
+    {
+        kernel.lightDir[k][lane] = lightDir[k];
+        kernel.viewDir[k][lane] = viewDir[k];
+        kernel.halfwayDir[k][lane] = halfwayDir[k];
+        kernel.normal[k][lane] = normalWS[k];
+        kernel.albedo[k][lane] = albedoLinear[k];
+        kernel.param[k][lane] = param[k];
+        kernel.radiance[k][lane] = lightRadiance[k];
+    }
+    kernel.shadow[lane] = shadowScale;
+    batch.emissive[lane] = gbuffer.emissive;
+    batch.otherRadiance[lane] = otherRadiance;
+}
+
+// Ambient, emission and the other lights are added to the direct light of a lane, then
+// the color is tonemapped and gamma corrected as in CalculateLight() of the shaders
+template <bool PBR>
+static Color3 ResolveLightingLane(const LightingBatch& batch, int lane)
+{
+    const LightingKernel::Batch& kernel = batch.kernel;
+
+    Color3 albedoLinear, lightRadiance, direct;
+    for (int k = 0; k < 3; ++k)
+    {
+        albedoLinear[k] = kernel.albedo[k][lane];
+        lightRadiance[k] = kernel.radiance[k][lane];
+        direct[k] = batch.direct[k][lane];
+    }
+    Float  ao = kernel.param[0][lane];
+    Color3 emissiveLinear = Pow(batch.emissive[lane], Gamma);
+
+    // Blinn-Phong scales the emission by the light color
+    Color3 color = direct + batch.otherRadiance[lane] + Color3(0.3f) * albedoLinear * ao;
+    color += PBR ? emissiveLinear : emissiveLinear * lightRadiance;
+
+    // HDR Tonemapping & Gamma Correction
+    color = color / (color + Color3(1.f));
+    color = Pow(color, InvGamma);
+    return Clamp01(color);
+}
+
+// Lights a group of texels with one shading model, a kernel batch at a time
+template <bool PBR>
+static void LightGroup(const std::vector<LightingTexel>& group, const Point3f& eyePos,
+                       const std::vector<PointLight>& lights,
+                       const std::vector<int>* tileRow, LightingBatch& batch,
+                       std::vector<Color3>& row)
+{
+    const int batchSize = LightingKernel::BatchSize;
+    for (size_t first = 0; first < group.size(); first += batchSize)
+    {
+        int count = (int)Min(group.size() - first, (size_t)batchSize);
+        for (int lane = 0; lane < count; ++lane)
+        {
+            const LightingTexel& texel = group[first + lane];
+            PrepareLightingLane<PBR>(texel, eyePos, lights,
+                                     tileRow[texel.x / s_LightTileSize], batch, lane);
+        }
+
+        if (PBR)
+            LightingKernel::CookTorrance(batch.kernel, count, batch.direct);
+        else
+            LightingKernel::BlinnPhong(batch.kernel, count, batch.direct);
+
+        for (int lane = 0; lane < count; ++lane)
+        {
+            const LightingTexel& texel = group[first + lane];
+            row[texel.x] += ResolveLightingLane<PBR>(batch, lane) * texel.weight;
+        }
+    }
+}
+
+// A multisampled pixel is an edge if its samples come from different surfaces (packed
+// texels of one surface only differ in their reconstructed positions)
+static bool IsEdgePixel(int x, int y, int height, int numSamples)
+{
+    if (ForkerGL::GetGBufferFormat() == ForkerGL::Packed)
+    {
+        for (int s = 1; s < numSamples; ++s)
+        {
+            if (!ForkerGL::PackedGBuffers.IsSameTexel(x, y, x, y + s * height))
+                return true;
+        }
+        return false;
+    }
+
+    Point3f  positionWS = ForkerGL::WorldPosGBuffer.GetValue(x, y);
+    Vector3f normalWS = ForkerGL::NormalGBuffer.GetValue(x, y);
+    Float    shadingType = ForkerGL::ShadingTypeGBuffer.GetValue(x, y);
+    for (int s = 1; s < numSamples; ++s)
+    {
+        int sy = y + s * height;
+        if (ForkerGL::ShadingTypeGBuffer.GetValue(x, sy) != shadingType ||
+            ForkerGL::NormalGBuffer.GetValue(x, sy) != normalWS ||
+            ForkerGL::WorldPosGBuffer.GetValue(x, sy) != positionWS)
+            return true;
+    }
+    return false;
+}
+
+void ForkerGL::BuildTileLights(const Scene& scene)
+{
+    BuildTileLightLists(scene.GetPointLights(), FrameBuffer.GetWidth(),
+                        FrameBuffer.GetHeight());
+}
+
+// Lighting work of a row, grouped by shading model (reused by each worker)
+static thread_local std::vector<LightingTexel> s_LightingGroups[2];  // Blinn-Phong, PBR
+static thread_local std::vector<Color3>        s_LightingRow;
+static thread_local LightingBatch              s_LightingBatch;
+
+void ForkerGL::DrawScreenSpacePixels(const Scene& scene)
+{
+    // Data Preparation
+    Point3f                        eyePos = scene.GetCamera().GetPosition();
+    const std::vector<PointLight>& lights = scene.GetPointLights();
+    int                            screenWidth = ForkerGL::FrameBuffer.GetWidth();
+    int                            screenHeight = ForkerGL::FrameBuffer.GetHeight();
+    int numTilesX = (screenWidth + s_LightTileSize - 1) / s_LightTileSize;
+
+    s_LightEvaluations = 0;
+
+    // Multisampling: pixels whose samples are all from the same surface are lit once,
+    // edge pixels are lit per sample and averaged
+    std::atomic<long long> edgePixelCount(0);
+
+    // Rows are independent jobs. Each row is lit one shading model at a time, so the
+    // texels of a group fill the 8 lanes of the lighting kernel of their model.
+    GetThreadPool().ParallelFor(screenHeight, [&](int y) {
+        std::vector<LightingTexel>* groups = s_LightingGroups;
+        std::vector<Color3>&        row = s_LightingRow;
+        groups[0].clear();
+        groups[1].clear();
+        row.assign(screenWidth, Color3(0.f));
+
+        long long rowEdgeCount = 0;
+        for (int x = 0; x < screenWidth; ++x)
+        {
+            if (s_PixelMask && s_PixelMask->GetValue(x, y) == 0.f) continue;
+
+            Float ao = ForkerGL::AmbientOcclusionGBuffer.GetValue(x, y);
+            bool  edge =
+                s_SampleCount > 1 && IsEdgePixel(x, y, screenHeight, s_SampleCount);
+            int   numSamples = edge ? s_SampleCount : 1;
+            for (int s = 0; s < numSamples; ++s)
             {
-                Vector3f halfwayDir = Normalize(lightDir + viewDir);
-                color = PBRShader::CalculateLight(lightDir, viewDir, halfwayDir, normalWS, visibility, albedo, emissive, param, lightRadiance);
+                int  sy = y + s * screenHeight;
+                bool pbr = ForkerGL::ReadGBufferShadingType(x, sy) >= 0.5f;
+                groups[pbr].push_back({ x, sy, ao, 1.f / (Float)numSamples });
             }
+            rowEdgeCount += edge;
+        }
+
+        const std::vector<int>* tileRow =
+            s_TileLights.data() + (y / s_LightTileSize) * numTilesX;
+        LightGroup<false>(groups[0], eyePos, lights, tileRow, s_LightingBatch, row);
+        LightGroup<true>(groups[1], eyePos, lights, tileRow, s_LightingBatch, row);
 
-            ForkerGL::FrameBuffer.SetValue(x, y, color);
+        for (int x = 0; x < screenWidth; ++x)
+        {
+            if (s_PixelMask && s_PixelMask->GetValue(x, y) == 0.f) continue;
+            ForkerGL::FrameBuffer.SetValue(x, y, row[x]);
         }
+        edgePixelCount += rowEdgeCount;
+    });
+
+    if (lights.size() > 1)
+    {
+        size_t maxTileLights = 0, totalTileLights = 0;
+        for (const std::vector<int>& tileLights : s_TileLights)
+        {
+            maxTileLights = std::max(maxTileLights, tileLights.size());
+            totalTileLights += tileLights.size();
+        }
+        spdlog::info("  [Tiled Lighting] other lights: {}, per {}x{} tile: {:.1f} (max "
+                     "{}), per pixel: {:.2f}",
+                     lights.size() - 1, s_LightTileSize, s_LightTileSize,
+                     (double)totalTileLights / s_TileLights.size(), maxTileLights,
+                     (double)s_LightEvaluations / ((double)screenWidth * screenHeight));
     }
-}
\ No newline at end of file
+    if (s_SampleCount > 1)
+        spdlog::info("  [MSAA] edge pixels lit per sample: {} / {}",
+                     edgePixelCount.load(), (long long)screenWidth * screenHeight);
+}
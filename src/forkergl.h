@@ -7,12 +7,21 @@
 #include <vector>
 
 #include "buffer.h"
+#include "gbuffer.h"
 #include "geometry.h"
+#include "hizbuffer.h"
 #include "shader.h"
 #include "texture.h"
 
 class Scene;
 class TGAImage;
+class ThreadPool;
+struct BinnedTriangle;
+struct DrawContext;
+struct FragmentOutput;
+struct Shader;
+struct TriangleSetup;
+struct TriangleVaryings;
 
 struct ForkerGL
 {
@@ -21,7 +30,8 @@ struct ForkerGL
     enum RenderMode
     {
         Forward,
-        Deferred
+        Deferred,
+        Visibility  // visibility buffer, then shading of the visible pixels
     };
 
     enum PassType
@@ -29,7 +39,38 @@ struct ForkerGL
         ForwardPass,
         GeometryPass,
         LightingPass,
-        ShadowPass
+        ShadowPass,
+        DepthPrePass,    // depth only, no fragment shading
+        VisibilityPass,  // depth and the draw & face ids, no fragment shading
+        NumPassTypes
+    };
+
+    enum DepthFunc
+    {
+        Less,
+        Equal  // shading after a depth pre-pass
+    };
+
+    enum CullMode
+    {
+        CullNone,
+        CullBack,  // counter-clockwise triangles are front faces
+        CullFront
+    };
+
+    enum GBufferFormat
+    {
+        FullPrecision,
+        Packed  // 16 bytes per texel, world position reconstructed from depth
+    };
+
+    struct TriangleStats
+    {
+        long long submitted = 0;
+        long long faceCulled = 0;     // back-face or front-face culling
+        long long frustumCulled = 0;  // outside of the view frustum or off screen
+        long long degenerate = 0;
+        long long clipped = 0;  // crossed the near plane or the guard band
     };
 
     // Texture Wrap Mode & Filter Mode
@@ -40,17 +81,23 @@ struct ForkerGL
     static void TextureFilterMode(Texture::FilterMode filterMode);
 
     // Buffers
-    static Buffer3f FrameBuffer;
-    static Buffer1f DepthBuffer;
-    static Buffer1f ShadowBuffer;
-    static Buffer3f NormalGBuffer;  // G-Buffers
-    static Buffer3f WorldPosGBuffer;
-    static Buffer3f LightSpaceNDCPosGBuffer;
-    static Buffer3f AlbedoGBuffer;
-    static Buffer3f EmissiveGBuffer;
-    static Buffer3f ParamGBuffer;
-    static Buffer1f ShadingTypeGBuffer;
-    static Buffer1f AmbientOcclusionGBuffer;  // SSAO
+    static Buffer3f           FrameBuffer;
+    static TiledBuffer1f      DepthBuffer;
+    static HiZBuffer          DepthHiZBuffer;  // farthest depths of blocks & tiles
+    static BufferD24          ShadowBuffer;  // depths in [0, 1]
+    static Buffer3f           NormalGBuffer;  // G-Buffers (full precision)
+    static Buffer3f           WorldPosGBuffer;
+    static Buffer3f           LightSpaceNDCPosGBuffer;
+    static Buffer3f           AlbedoGBuffer;
+    static Buffer3f           EmissiveGBuffer;
+    static Buffer3f           ParamGBuffer;
+    static BufferR8           ShadingTypeGBuffer;
+    static PackedGBuffer      PackedGBuffers;           // G-Buffers (packed)
+    static BufferR8           AmbientOcclusionGBuffer;  // SSAO (per pixel)
+    static TiledBuffer1f      SampleDepthBuffer;        // MSAA
+    static Buffer3f           SampleColorBuffer;
+    static Buffer1u           VisibilityBuffer;       // draw id << 22 | face id
+    static DepthPayloadBuffer VisibilityDepthBuffer;  // sort-last visibility pass
 
     // Images
     static TGAImage AntiAliasedImage;
@@ -58,11 +105,12 @@ struct ForkerGL
     static void InitFrameBuffer(int width, int height);
     static void InitDepthBuffer(int width, int height);
     static void InitShadowBuffer(int width, int height);
-    static void InitGeometryBuffers(int width, int height);
+    static void InitGeometryBuffers(int width, int height);  // in the current format
+    static void InitVisibilityBuffer(int width, int height);  // also clears draw records
 
     // Update Status
     static void       ClearColor(const Color3& color);
-    static void       SetViewportMatrix(int x, int y, int w, int h);
+    static void       SetViewportMatrix(Float x, Float y, int w, int h);  // x, y: jitter
     static Matrix4x4f GetViewportMatrix();
     static void       SetViewProjectionMatrix(const Matrix4x4f& matrix);
     static Matrix4x4f GetViewProjectionMatrix();
@@ -71,13 +119,86 @@ struct ForkerGL
     static void       SetRenderMode(enum RenderMode mode);
     static RenderMode GetRenderMode();
     static void       SetPassType(enum PassType type);
+    static void       SetDepthFunc(enum DepthFunc func);
+    static DepthFunc  GetDepthFunc();
+    static void       SetCullMode(enum PassType pass, enum CullMode mode);
+    static CullMode   GetCullMode(enum PassType pass);
+    static void          SetGBufferFormat(enum GBufferFormat format);
+    static GBufferFormat GetGBufferFormat();
+    // Restricts rasterization and screen-space lighting to the pixels whose mask value
+    // is non-zero (nullptr: every pixel)
+    static void       SetPixelMask(const Buffer1f* mask);
+
+    // Multithreading (tile-binned rasterization)
+    static void        SetThreadCount(int count);  // <= 0 means all hardware threads
+    static int         GetThreadCount();
+    static void        SetTileSize(int size);
+    static int         GetTileSize();
+    static ThreadPool& GetThreadPool();
+    // Sort-Last Visibility Pass: triangles are rasterized in parallel batches without
+    // tile ownership, depth & ids are merged by an atomic minimum
+    static void        SetSortLast(bool enabled);
+    static bool        IsSortLastOn();
+
+    // Multisample Anti-Aliasing: camera passes store coverage & depth per sample but
+    // shade once per pixel per triangle. Sample s of pixel (x, y) is at (x, y + s *
+    // height) of the sample buffers and of the G-buffers.
+    static void SetSampleCount(int count);  // 1 (off), 2, 4 or 8
+    static int  GetSampleCount();
+    static void ResolveFrameBuffer();  // average of the color samples
+    static void ResolveDepthBuffer();  // sample 0 (matches the first G-buffer plane)
+    static void ResolveDepthClears();  // writes the blocks still flagged as cleared
+
+    // G-Buffer Access in either format (sy: row including the sample plane)
+    static void           WriteGBuffers(int x, int sy, const FragmentOutput& out);
+    static FragmentOutput ReadGBuffers(int x, int sy);
+    static Point3f        ReadGBufferPosition(int x, int sy);
+    static Vector3f       ReadGBufferNormal(int x, int sy);
+    static Float          ReadGBufferShadingType(int x, int sy);
 
     // Rasterization
-    static void DrawTriangle(const Point4f ndcVerts[3], Shader& shader);
+    // Bin only: the varyings, context and shader are referenced until Flush()
+    static void DrawTriangle(const Point4f clipVerts[3], const TriangleVaryings& varyings,
+                             const DrawContext& context, const Shader& shader,
+                             int faceIdx);
+    static void Flush();  // rasterize and shade all binned triangles
+
+    // Deferred Lighting: the other point lights are listed per screen tile from the
+    // G-buffer positions once per frame, then every lighting pass of the frame reuses
+    // the lists
+    static void BuildTileLights(const Scene& scene);
     static void DrawScreenSpacePixels(const Scene& scene);
 
+    // Visibility Buffer: draws of the visibility pass are recorded (a copy of the
+    // context, the shader is referenced until the buffer is shaded). Sets the draw id
+    // of the context, which stays -1 in other passes.
+    static void RecordDraw(DrawContext& context, const Shader& shader);
+    // Runs the fragment shader once per visible pixel, with the varyings rebuilt from
+    // the vertices of its triangle, and writes the frame buffer
+    static void ShadeVisibilityBuffer();
+    // Copies the sort-last depths & ids to DepthBuffer and VisibilityBuffer
+    static void ResolveVisibilityBuffer();
+
+    // Statistics (since the last reset)
+    static void                 ResetFragmentCount();
+    static long long            GetFragmentCount();  // fragments that passed depth test
+    static void                 ResetTriangleStats();
+    static const TriangleStats& GetTriangleStats();
+
 private:
-    static void DrawTriangleSubTask(int xMin, int xMax, int yMin, int yMax,
-                                    const Point2i points[3], Shader& shader,
-                                    const Point3f& depths);
+    // Perspective division, culling and binning of a clipped or unclipped triangle
+    static void BinTriangle(const Point4f clipVerts[3], const Matrix3x3f* baryTransform,
+                            const TriangleVaryings& varyings, const DrawContext& context,
+                            const Shader& shader, int faceIdx);
+
+    // Returns the number of fragments that passed the depth test. The inner loop is
+    // specialized on the concrete shader and the pass (ShaderT = Shader is the virtual
+    // fallback for custom shaders)
+    template <typename ShaderT, PassType Pass>
+    static int DrawTriangleSubTask(int xMin, int xMax, int yMin, int yMax,
+                                   const BinnedTriangle& triangle, const ShaderT& shader);
+
+    // Picks the DrawTriangleSubTask specialization for the shader and the current pass
+    static int DispatchTriangleSubTask(int xMin, int xMax, int yMin, int yMax,
+                                       const BinnedTriangle& triangle);
 };
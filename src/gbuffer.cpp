@@ -0,0 +1,122 @@
+#include "gbuffer.h"
+
+#include <cmath>
+#include <cstring>
+
+#include "utility.h"
+
+static uint8_t ToUnorm8(Float v)
+{
+    return (uint8_t)(Clamp01(v) * 255.f + 0.5f);
+}
+
+static Float FromUnorm8(uint8_t v)
+{
+    return v / 255.f;
+}
+
+static uint16_t ToSnorm16(Float v)
+{
+    return (uint16_t)(int16_t)std::lround(Clamp(v, -1.f, 1.f) * 32767.f);
+}
+
+static Float FromSnorm16(uint16_t v)
+{
+    return Max((Float)(int16_t)v / 32767.f, -1.f);
+}
+
+// Octahedral Normal Encoding: the unit sphere is projected onto the octahedron
+// |x| + |y| + |z| = 1, whose lower half is folded over the upper one
+static Vector2f EncodeOctahedral(const Vector3f& n)
+{
+    Float sum = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (sum == 0.f) return Vector2f(0.f);  // cleared texels (decoded as +z)
+
+    Vector2f e(n.x / sum, n.y / sum);
+    if (n.z < 0.f)
+    {
+        Vector2f folded((1.f - std::abs(e.y)) * (e.x >= 0.f ? 1.f : -1.f),
+                        (1.f - std::abs(e.x)) * (e.y >= 0.f ? 1.f : -1.f));
+        e = folded;
+    }
+    return e;
+}
+
+static Vector3f DecodeOctahedral(const Vector2f& e)
+{
+    Vector3f n(e.x, e.y, 1.f - std::abs(e.x) - std::abs(e.y));
+    Float    t = Max(-n.z, 0.f);
+    n.x += (n.x >= 0.f) ? -t : t;
+    n.y += (n.y >= 0.f) ? -t : t;
+    return Normalize(n);
+}
+
+PackedGBuffer::PackedGBuffer(int w, int h) : Buffer(0, 0)
+{
+    Reset(w, h);
+}
+
+void PackedGBuffer::Reset(int w, int h)
+{
+    m_Width = w;
+    m_Height = h;
+    m_Data.resize(w * h);
+    std::memset(m_Data.data(), 0, m_Data.size() * sizeof(PackedGBufferTexel));
+}
+
+void PackedGBuffer::SetValue(int x, int y, const Vector3f& normal, const Color3& albedo,
+                             const Color3& emissive, const Vector3f& param,
+                             Float shadingType)
+{
+    PackedGBufferTexel& texel = m_Data[x + y * m_Width];
+
+    Vector2f octahedral = EncodeOctahedral(normal);
+    texel.normal[0] = ToSnorm16(octahedral.x);
+    texel.normal[1] = ToSnorm16(octahedral.y);
+
+    bool pbr = shadingType >= 0.5f;
+    for (int i = 0; i < 3; ++i)
+    {
+        texel.albedo[i] = ToUnorm8(albedo[i]);
+        texel.emissive[i] = ToUnorm8(emissive[i]);
+    }
+    texel.param[0] = ToUnorm8(param.x);
+    texel.param[1] = ToUnorm8(param.y);
+    texel.param[2] = ToUnorm8(pbr ? param.z : param.z / MaxShininess);
+    texel.materialId = pbr ? 1 : 0;
+}
+
+Vector3f PackedGBuffer::GetNormal(int x, int y) const
+{
+    const PackedGBufferTexel& texel = GetTexel(x, y);
+    return DecodeOctahedral(
+        Vector2f(FromSnorm16(texel.normal[0]), FromSnorm16(texel.normal[1])));
+}
+
+Color3 PackedGBuffer::GetAlbedo(int x, int y) const
+{
+    const PackedGBufferTexel& texel = GetTexel(x, y);
+    return Color3(FromUnorm8(texel.albedo[0]), FromUnorm8(texel.albedo[1]),
+                  FromUnorm8(texel.albedo[2]));
+}
+
+Color3 PackedGBuffer::GetEmissive(int x, int y) const
+{
+    const PackedGBufferTexel& texel = GetTexel(x, y);
+    return Color3(FromUnorm8(texel.emissive[0]), FromUnorm8(texel.emissive[1]),
+                  FromUnorm8(texel.emissive[2]));
+}
+
+Vector3f PackedGBuffer::GetParam(int x, int y) const
+{
+    const PackedGBufferTexel& texel = GetTexel(x, y);
+    Float                     z = FromUnorm8(texel.param[2]);
+    return Vector3f(FromUnorm8(texel.param[0]), FromUnorm8(texel.param[1]),
+                    texel.materialId ? z : z * MaxShininess);
+}
+
+bool PackedGBuffer::IsSameTexel(int x0, int y0, int x1, int y1) const
+{
+    return std::memcmp(&GetTexel(x0, y0), &GetTexel(x1, y1),
+                       sizeof(PackedGBufferTexel)) == 0;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "buffer.h"
+#include "color.h"
+#include "geometry.h"
+
+// Packed G-Buffer Texel: 16 bytes instead of the 76 bytes of the full-precision
+// G-buffers. World position and light-space NDC are not stored, they are reconstructed
+// from depth.
+struct PackedGBufferTexel
+{
+    uint16_t normal[2];   // octahedral, 2 x snorm16
+    uint8_t  albedo[3];   // sRGB (as sampled from textures)
+    uint8_t  materialId;  // shading type: 0 for Blinn-Phong, 1 for PBR
+    uint8_t  emissive[3];
+    uint8_t  param[3];  // unorm8 (Blinn-Phong shininess over [0, MaxShininess])
+    uint8_t  padding[2];
+};
+static_assert(sizeof(PackedGBufferTexel) == 16, "packed texels are 16 bytes");
+
+class PackedGBuffer : public Buffer
+{
+public:
+    static constexpr Float MaxShininess = 64.f;
+
+    PackedGBuffer() : Buffer(0, 0) { }
+    explicit PackedGBuffer(int w, int h);  // zeros
+
+    void Reset(int w, int h);  // zeros, reuses the storage
+
+    void SetValue(int x, int y, const Vector3f& normal, const Color3& albedo,
+                  const Color3& emissive, const Vector3f& param, Float shadingType);
+
+    Vector3f GetNormal(int x, int y) const;
+    Color3   GetAlbedo(int x, int y) const;
+    Color3   GetEmissive(int x, int y) const;
+    Vector3f GetParam(int x, int y) const;
+    Float    GetShadingType(int x, int y) const { return GetTexel(x, y).materialId; }
+
+    // Every stored attribute is the same (MSAA samples of one surface)
+    bool IsSameTexel(int x0, int y0, int x1, int y1) const;
+
+private:
+    const PackedGBufferTexel& GetTexel(int x, int y) const
+    {
+        return m_Data[x + y * m_Width];
+    }
+
+    std::vector<PackedGBufferTexel> m_Data;
+};
@@ -0,0 +1,85 @@
+#include "hizbuffer.h"
+
+void HiZBuffer::Build(const TiledBuffer1f& depthBuffer, int tileSize)
+{
+    m_NumBlocksX = (depthBuffer.GetWidth() + BlockSize - 1) / BlockSize;
+    m_NumBlocksY = (depthBuffer.GetHeight() + BlockSize - 1) / BlockSize;
+    m_BlockMin.resize(m_NumBlocksX * m_NumBlocksY);
+    m_BlockMax.resize(m_NumBlocksX * m_NumBlocksY);
+    m_BlockCleared.resize(m_NumBlocksX * m_NumBlocksY);
+
+    for (int by = 0; by < m_NumBlocksY; ++by)
+    {
+        for (int bx = 0; bx < m_NumBlocksX; ++bx)
+        {
+            UpdateBlock(bx, by, depthBuffer);
+        }
+    }
+    SetTileSize(tileSize);
+}
+
+void HiZBuffer::Clear(int width, int height, int tileSize)
+{
+    m_NumBlocksX = (width + BlockSize - 1) / BlockSize;
+    m_NumBlocksY = (height + BlockSize - 1) / BlockSize;
+    m_BlockMin.assign(m_NumBlocksX * m_NumBlocksY, MaxFloat);
+    m_BlockMax.assign(m_NumBlocksX * m_NumBlocksY, MaxFloat);
+    m_BlockCleared.assign(m_NumBlocksX * m_NumBlocksY, 1);
+    SetTileSize(tileSize);
+}
+
+void HiZBuffer::SetTileSize(int tileSize)
+{
+    int blocksPerTile = tileSize / BlockSize;
+    int numTilesY = (m_NumBlocksY + blocksPerTile - 1) / blocksPerTile;
+
+    m_TileSize = tileSize;
+    m_NumTilesX = (m_NumBlocksX + blocksPerTile - 1) / blocksPerTile;
+    m_TileMax.resize(m_NumTilesX * numTilesY);
+
+    for (int ty = 0; ty < numTilesY; ++ty)
+    {
+        for (int tx = 0; tx < m_NumTilesX; ++tx)
+        {
+            UpdateTile(tx, ty);
+        }
+    }
+}
+
+void HiZBuffer::UpdateBlock(int bx, int by, const TiledBuffer1f& depthBuffer)
+{
+    int xMax = Min((bx + 1) * BlockSize, depthBuffer.GetWidth());
+    int yMax = Min((by + 1) * BlockSize, depthBuffer.GetHeight());
+
+    Float nearest = MaxFloat, farthest = 0.f;
+    for (int y = by * BlockSize; y < yMax; ++y)
+    {
+        const Float* span = depthBuffer.GetSpan(bx * BlockSize, y);  // one block row
+        for (int i = 0; i < xMax - bx * BlockSize; ++i)
+        {
+            nearest = Min(nearest, span[i]);
+            farthest = Max(farthest, span[i]);
+        }
+    }
+    int block = bx + by * m_NumBlocksX;
+    m_BlockMin[block] = nearest;
+    m_BlockMax[block] = farthest;
+    m_BlockCleared[block] = 0;
+}
+
+void HiZBuffer::UpdateTile(int tx, int ty)
+{
+    int blocksPerTile = m_TileSize / BlockSize;
+    int bxMax = Min((tx + 1) * blocksPerTile, m_NumBlocksX);
+    int byMax = Min((ty + 1) * blocksPerTile, m_NumBlocksY);
+
+    Float farthest = 0.f;
+    for (int by = ty * blocksPerTile; by < byMax; ++by)
+    {
+        for (int bx = tx * blocksPerTile; bx < bxMax; ++bx)
+        {
+            farthest = Max(farthest, GetBlockMax(bx, by));
+        }
+    }
+    m_TileMax[tx + ty * m_NumTilesX] = farthest;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "buffer.h"
+
+// Hierarchical Z-Buffer: farthest stored depth of every 8x8 block (fine level) and of
+// every raster tile (coarse level). Depths only get nearer with the less-than test, so
+// a primitive whose nearest depth is not in front of the farthest one is occluded.
+//
+// Blocks also keep their nearest depth and a cleared flag. A cleared block has not been
+// written since the last Clear() and its depths in memory are undefined, so clearing
+// costs one flag per block and the depth test of a cleared block needs no depth reads.
+class HiZBuffer
+{
+public:
+    static const int BlockSize = 8;
+
+    HiZBuffer() : m_TileSize(0), m_NumBlocksX(0), m_NumBlocksY(0), m_NumTilesX(0) { }
+
+    // Builds both levels from the depth buffer (tileSize is a multiple of BlockSize)
+    void Build(const TiledBuffer1f& depthBuffer, int tileSize);
+
+    // Flags every block as cleared to the farthest depth
+    void Clear(int width, int height, int tileSize);
+
+    // Regroups the blocks into tiles of another size
+    void SetTileSize(int tileSize);
+
+    int   GetNumBlocksX() const { return m_NumBlocksX; }
+    int   GetNumBlocksY() const { return m_NumBlocksY; }
+    Float GetBlockMin(int bx, int by) const { return m_BlockMin[bx + by * m_NumBlocksX]; }
+    Float GetBlockMax(int bx, int by) const { return m_BlockMax[bx + by * m_NumBlocksX]; }
+    Float GetTileMax(int tx, int ty) const { return m_TileMax[tx + ty * m_NumTilesX]; }
+    bool  IsBlockCleared(int bx, int by) const
+    {
+        return m_BlockCleared[bx + by * m_NumBlocksX] != 0;
+    }
+
+    // Called after depth writes (the block and tile must be owned by the caller)
+    void UpdateBlock(int bx, int by, const TiledBuffer1f& depthBuffer);
+    void UpdateTile(int tx, int ty);
+
+private:
+    int                  m_TileSize;
+    int                  m_NumBlocksX, m_NumBlocksY;
+    int                  m_NumTilesX;
+    std::vector<Float>   m_BlockMin;
+    std::vector<Float>   m_BlockMax;
+    std::vector<uint8_t> m_BlockCleared;
+    std::vector<Float>   m_TileMax;
+};
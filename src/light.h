@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include "check.h"
+#include "color.h"
 #include "geometry.h"
 #include "tgaimage.h"
 
@@ -46,16 +48,28 @@ class PointLight : public Light
 {
 public:
     Vector3f position;
+    Float    radius;  // range of the light, 0 for no falloff
 
-    explicit PointLight() : Light(Vector3f(1.f)), position(0.f) { }
+    explicit PointLight() : Light(Vector3f(1.f)), position(0.f), radius(0.f) { }
 
-    explicit PointLight(Float x, Float y, Float z, const Vector3f& c = Vector3f(1.f))
-        : Light(c), position(x, y, z)
+    explicit PointLight(Float x, Float y, Float z, const Vector3f& c = Vector3f(1.f),
+                        Float r = 0.f)
+        : Light(c), position(x, y, z), radius(r)
     {
     }
 
-    explicit PointLight(const Vector3f& pos, const Vector3f& c = Vector3f(1.f))
-        : Light(c), position(pos)
+    explicit PointLight(const Vector3f& pos, const Vector3f& c = Vector3f(1.f),
+                        Float r = 0.f)
+        : Light(c), position(pos), radius(r)
+    {
+    }
+
+    // Inverse-square falloff windowed to reach zero at the radius
+    Float Attenuation(Float distance) const
     {
+        if (radius <= 0.f) return 1.f;
+        Float ratio = distance / radius;
+        Float window = Clamp01(1.f - ratio * ratio * ratio * ratio);
+        return window * window / (distance * distance + 1.f);
     }
 };
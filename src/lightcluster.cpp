@@ -0,0 +1,127 @@
+#include "lightcluster.h"
+
+#include <cmath>
+
+#include "forkergl.h"
+#include "threadpool.h"
+
+const int LightClusters::TileSize;
+const int LightClusters::NumSlices;
+
+void LightClusters::Build(const std::vector<PointLight>& lights,
+                          const Matrix4x4f& viewMatrix,
+                          const Matrix4x4f& projectionMatrix,
+                          const Matrix4x4f& viewportMatrix, Float nearPlane,
+                          Float farPlane)
+{
+    m_Lights = &lights;
+    m_ViewMatrix = viewMatrix;
+    m_ProjectionMatrix = projectionMatrix;
+    m_ViewportMatrix = viewportMatrix;
+    m_NearPlane = nearPlane;
+    m_FarPlane = farPlane;
+    m_SliceScale = NumSlices / std::log(farPlane / nearPlane);
+
+    int width = (int)std::ceil(viewportMatrix[0][0] * 2.f);
+    int height = (int)std::ceil(viewportMatrix[1][1] * 2.f);
+    m_NumTilesX = (width + TileSize - 1) / TileSize;
+    m_NumTilesY = (height + TileSize - 1) / TileSize;
+    m_Clusters.resize(m_NumTilesX * m_NumTilesY * NumSlices);
+
+    // Lights in view space
+    std::vector<Point3f> lightPositionsVS(lights.size());
+    for (size_t i = 1; i < lights.size(); ++i)
+        lightPositionsVS[i] = (viewMatrix * Point4f(lights[i].position, 1.f)).xyz;
+
+    // Screen space -> view space
+    Matrix4x4f inverseMatrix = (viewportMatrix * projectionMatrix).Inverse();
+    auto       unproject = [&](Float x, Float y, Float z) {
+        Point4f p = inverseMatrix * Point4f(x, y, z, 1.f);
+        return Point3f(p.xyz / p.w);
+    };
+
+    int numTiles = m_NumTilesX * m_NumTilesY;
+    ForkerGL::GetThreadPool().ParallelFor(numTiles, [&](int tile) {
+        int tileX = tile % m_NumTilesX, tileY = tile / m_NumTilesX;
+
+        // View rays through the tile corners (two points of each, as this works for
+        // both projections)
+        Point3f rayA[4], rayB[4];
+        for (int c = 0; c < 4; ++c)
+        {
+            Float x = (Float)((tileX + (c & 1)) * TileSize);
+            Float y = (Float)((tileY + (c >> 1)) * TileSize);
+            rayA[c] = unproject(x, y, 0.f);
+            rayB[c] = unproject(x, y, 1.f);
+        }
+
+        for (int slice = 0; slice < NumSlices; ++slice)
+        {
+            std::vector<int>& cluster = m_Clusters[tile + slice * numTiles];
+            cluster.clear();
+
+            // View-space bounds of the froxel (view depth increases along -z)
+            Float   depths[2] = { nearPlane * std::exp(slice / m_SliceScale),
+                                nearPlane * std::exp((slice + 1) / m_SliceScale) };
+            Point3f boundsMin(MaxFloat), boundsMax(-MaxFloat);
+            for (int c = 0; c < 4; ++c)
+            {
+                for (Float depth : depths)
+                {
+                    Float   t = (depth + rayA[c].z) / (rayA[c].z - rayB[c].z);
+                    Point3f p = rayA[c] + (rayB[c] - rayA[c]) * t;
+                    for (int axis = 0; axis < 3; ++axis)
+                    {
+                        boundsMin[axis] = Min(boundsMin[axis], p[axis]);
+                        boundsMax[axis] = Max(boundsMax[axis], p[axis]);
+                    }
+                }
+            }
+
+            // Sphere & box overlap (lights without a radius reach every froxel)
+            for (int i = 1; i < (int)lights.size(); ++i)
+            {
+                Float radius = lights[i].radius;
+                if (radius > 0.f)
+                {
+                    Float distanceSquared = 0.f;
+                    for (int axis = 0; axis < 3; ++axis)
+                    {
+                        Float v = lightPositionsVS[i][axis];
+                        Float delta = v - Clamp(v, boundsMin[axis], boundsMax[axis]);
+                        distanceSquared += delta * delta;
+                    }
+                    if (distanceSquared >= radius * radius) continue;
+                }
+                cluster.push_back(i);
+            }
+        }
+    });
+}
+
+Float LightClusters::GetAverageClusterLightCount() const
+{
+    size_t total = 0;
+    for (const std::vector<int>& cluster : m_Clusters)
+        total += cluster.size();
+    return m_Clusters.empty() ? 0.f : (Float)total / m_Clusters.size();
+}
+
+int LightClusters::GetSlice(Float viewDepth) const
+{
+    if (viewDepth <= m_NearPlane) return 0;
+    int slice = (int)(std::log(viewDepth / m_NearPlane) * m_SliceScale);
+    return Min(slice, NumSlices - 1);
+}
+
+const std::vector<int>& LightClusters::GetLights(const Point3f& positionWS) const
+{
+    Point4f positionVS = m_ViewMatrix * Point4f(positionWS, 1.f);
+    Point4f positionCS = m_ProjectionMatrix * positionVS;
+    Point3f positionSS = (m_ViewportMatrix * (positionCS / positionCS.w)).xyz;
+
+    int tileX = Clamp((int)std::floor(positionSS.x / TileSize), 0, m_NumTilesX - 1);
+    int tileY = Clamp((int)std::floor(positionSS.y / TileSize), 0, m_NumTilesY - 1);
+    int slice = GetSlice(-positionVS.z);
+    return m_Clusters[tileX + tileY * m_NumTilesX + slice * m_NumTilesX * m_NumTilesY];
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+
+#include "geometry.h"
+#include "light.h"
+
+// Clustered Lighting: the view frustum is split into froxels (screen tiles x exponential
+// view depth slices) and every froxel lists the point lights that can reach it. Point
+// light 0 is the shadowed light and is never listed.
+class LightClusters
+{
+public:
+    static const int TileSize = 64;  // pixels
+    static const int NumSlices = 24;
+
+    LightClusters() : m_Lights(nullptr), m_NumTilesX(0), m_NumTilesY(0) { }
+
+    // Assigns the lights to the froxels in parallel (lights are referenced until the
+    // next build)
+    void Build(const std::vector<PointLight>& lights, const Matrix4x4f& viewMatrix,
+               const Matrix4x4f& projectionMatrix, const Matrix4x4f& viewportMatrix,
+               Float nearPlane, Float farPlane);
+
+    int   GetLightCount() const { return m_Lights ? (int)m_Lights->size() - 1 : 0; }
+    int   GetNumTilesX() const { return m_NumTilesX; }
+    int   GetNumTilesY() const { return m_NumTilesY; }
+    Float GetAverageClusterLightCount() const;
+
+    // Light indices of the froxel containing a world-space position
+    const std::vector<int>& GetLights(const Point3f& positionWS) const;
+
+    // Calls func(lightDir, radiance) for every light of the froxel that reaches the
+    // position, with the direction to the light and the attenuated radiance
+    template <typename Func>
+    void ForEachLight(const Point3f& positionWS, Func func) const
+    {
+        for (int index : GetLights(positionWS))
+        {
+            const PointLight& light = (*m_Lights)[index];
+            Vector3f          toLight = light.position - positionWS;
+            Float             distance = toLight.Length();
+            Float             attenuation = light.Attenuation(distance);
+            if (attenuation <= 0.f || distance <= 0.f) continue;
+            func(toLight / distance, light.color * attenuation);
+        }
+    }
+
+private:
+    int GetSlice(Float viewDepth) const;
+
+    const std::vector<PointLight>* m_Lights;
+    Matrix4x4f                     m_ViewMatrix;
+    Matrix4x4f                     m_ProjectionMatrix;
+    Matrix4x4f                     m_ViewportMatrix;
+    Float                          m_NearPlane, m_FarPlane;
+    Float                          m_SliceScale;  // NumSlices / log(far / near)
+    int                            m_NumTilesX, m_NumTilesY;
+    std::vector<std::vector<int>>  m_Clusters;  // x fastest, then y, then slice
+};
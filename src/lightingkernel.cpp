@@ -0,0 +1,303 @@
+#include "lightingkernel.h"
+
+#include "pbrshader.h"
+#include "phongshader.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__)) && !defined(FLOAT_AS_DOUBLE)
+#define LIGHTING_KERNEL_X86
+#include <immintrin.h>
+#endif
+
+namespace LightingKernel
+{
+
+static Vector3f getLane(const Float v[3][BatchSize], int i)
+{
+    return Vector3f(v[0][i], v[1][i], v[2][i]);
+}
+
+static void setLane(Float v[3][BatchSize], int i, const Vector3f& value)
+{
+    v[0][i] = value.x;
+    v[1][i] = value.y;
+    v[2][i] = value.z;
+}
+
+static void blinnPhongScalar(const Batch& batch, int count, Float out[3][BatchSize])
+{
+    for (int i = 0; i < count; ++i)
+    {
+        Color3 radiance = BlinnPhongShader::CalculateRadiance(
+            getLane(batch.lightDir, i), getLane(batch.halfwayDir, i),
+            getLane(batch.normal, i), getLane(batch.albedo, i), getLane(batch.param, i),
+            getLane(batch.radiance, i));
+        setLane(out, i, radiance * batch.shadow[i]);
+    }
+}
+
+static void cookTorranceScalar(const Batch& batch, int count, Float out[3][BatchSize])
+{
+    for (int i = 0; i < count; ++i)
+    {
+        Color3 radiance = PBRShader::CalculateRadiance(
+            getLane(batch.lightDir, i), getLane(batch.viewDir, i),
+            getLane(batch.halfwayDir, i), getLane(batch.normal, i),
+            getLane(batch.albedo, i), getLane(batch.param, i),
+            getLane(batch.radiance, i));
+        setLane(out, i, radiance * batch.shadow[i]);
+    }
+}
+
+#ifdef LIGHTING_KERNEL_X86
+
+#define LIGHTING_AVX2 __attribute__((target("avx2")))
+
+LIGHTING_AVX2 static __m256 set8(Float v)
+{
+    return _mm256_set1_ps(v);
+}
+
+LIGHTING_AVX2 static __m256 mulAdd8(__m256 a, __m256 b, Float c)
+{
+    return _mm256_add_ps(_mm256_mul_ps(a, b), _mm256_set1_ps(c));
+}
+
+LIGHTING_AVX2 static __m256 dot8(const __m256 a[3], const __m256 b[3])
+{
+    __m256 ret = _mm256_mul_ps(a[0], b[0]);
+    ret = _mm256_add_ps(ret, _mm256_mul_ps(a[1], b[1]));
+    return _mm256_add_ps(ret, _mm256_mul_ps(a[2], b[2]));
+}
+
+// Lanes [0, count) of a batch are set in the mask. The others hold stale texels, they
+// are loaded as zeros (every term stays finite) and never stored.
+LIGHTING_AVX2 static __m256i laneMask8(int count)
+{
+    return _mm256_cmpgt_epi32(_mm256_set1_epi32(count),
+                              _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+}
+
+LIGHTING_AVX2 static __m256 load8(const Float v[BatchSize], __m256i mask)
+{
+    return _mm256_maskload_ps(v, mask);
+}
+
+LIGHTING_AVX2 static void load8(const Float v[3][BatchSize], __m256i mask,
+                                __m256 out[3])
+{
+    for (int k = 0; k < 3; ++k)
+        out[k] = _mm256_maskload_ps(v[k], mask);
+}
+
+// exp() & log() of the Cephes library (relative error around 1e-7)
+LIGHTING_AVX2 static __m256 exp8(__m256 x)
+{
+    const Float limit = 88.3762626647949f;
+    x = _mm256_min_ps(_mm256_max_ps(x, set8(-limit)), set8(limit));
+
+    // x = n * ln(2) + r, with |r| <= ln(2) / 2
+    __m256 n = _mm256_floor_ps(mulAdd8(x, set8(1.44269504088896341f), 0.5f));
+    x = _mm256_sub_ps(x, _mm256_mul_ps(n, set8(0.693359375f)));
+    x = _mm256_sub_ps(x, _mm256_mul_ps(n, set8(-2.12194440e-4f)));
+
+    __m256 z = _mm256_mul_ps(x, x);
+    __m256 y = set8(1.9875691500e-4f);
+    y = mulAdd8(y, x, 1.3981999507e-3f);
+    y = mulAdd8(y, x, 8.3334519073e-3f);
+    y = mulAdd8(y, x, 4.1665795894e-2f);
+    y = mulAdd8(y, x, 1.6666665459e-1f);
+    y = mulAdd8(y, x, 5.0000001201e-1f);
+    y = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(y, z), x), set8(1.f));
+
+    // 2^n
+    __m256i exponent = _mm256_add_epi32(_mm256_cvttps_epi32(n), _mm256_set1_epi32(127));
+    return _mm256_mul_ps(y, _mm256_castsi256_ps(_mm256_slli_epi32(exponent, 23)));
+}
+
+LIGHTING_AVX2 static __m256 log8(__m256 x)  // x > 0
+{
+    x = _mm256_max_ps(x, _mm256_castsi256_ps(_mm256_set1_epi32(0x00800000)));
+
+    // x = m * 2^e, with m in [sqrt(0.5), sqrt(2))
+    __m256i bits = _mm256_castps_si256(x);
+    __m256  e = _mm256_cvtepi32_ps(
+        _mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126)));
+    x = _mm256_or_ps(
+        _mm256_castsi256_ps(_mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff))),
+        set8(0.5f));
+    __m256 small = _mm256_cmp_ps(x, set8(0.707106781186547524f), _CMP_LT_OQ);
+    e = _mm256_sub_ps(e, _mm256_and_ps(small, set8(1.f)));
+    x = _mm256_add_ps(_mm256_sub_ps(x, set8(1.f)), _mm256_and_ps(small, x));
+
+    __m256 z = _mm256_mul_ps(x, x);
+    __m256 y = set8(7.0376836292e-2f);
+    y = mulAdd8(y, x, -1.1514610310e-1f);
+    y = mulAdd8(y, x, 1.1676998740e-1f);
+    y = mulAdd8(y, x, -1.2420140846e-1f);
+    y = mulAdd8(y, x, 1.4249322787e-1f);
+    y = mulAdd8(y, x, -1.6668057665e-1f);
+    y = mulAdd8(y, x, 2.0000714765e-1f);
+    y = mulAdd8(y, x, -2.4999993993e-1f);
+    y = mulAdd8(y, x, 3.3333331174e-1f);
+    y = _mm256_mul_ps(_mm256_mul_ps(y, x), z);
+
+    y = _mm256_add_ps(y, _mm256_mul_ps(e, set8(-2.12194440e-4f)));
+    y = _mm256_sub_ps(y, _mm256_mul_ps(z, set8(0.5f)));
+    x = _mm256_add_ps(x, y);
+    return _mm256_add_ps(x, _mm256_mul_ps(e, set8(0.693359375f)));
+}
+
+// std::pow() for base >= 0
+LIGHTING_AVX2 static __m256 pow8(__m256 base, __m256 exponent)
+{
+    __m256 positive = _mm256_cmp_ps(base, _mm256_setzero_ps(), _CMP_GT_OQ);
+    __m256 power = exp8(_mm256_mul_ps(exponent, log8(base)));
+    __m256 zeroExponent = _mm256_cmp_ps(exponent, _mm256_setzero_ps(), _CMP_EQ_OQ);
+    __m256 zeroPower = _mm256_and_ps(zeroExponent, set8(1.f));  // 0^0 = 1
+    return _mm256_blendv_ps(zeroPower, power, positive);
+}
+
+LIGHTING_AVX2 static void blinnPhongAVX2(const Batch& batch, int count,
+                                         Float out[3][BatchSize])
+{
+    __m256i mask = laneMask8(count);
+
+    __m256 lightDir[3], halfwayDir[3], normal[3];
+    load8(batch.lightDir, mask, lightDir);
+    load8(batch.halfwayDir, mask, halfwayDir);
+    load8(batch.normal, mask, normal);
+
+    const __m256 zero = _mm256_setzero_ps();
+    __m256       ao = load8(batch.param[0], mask);
+    __m256       ks = load8(batch.param[1], mask);
+    __m256       shininess = load8(batch.param[2], mask);
+    __m256       shadow = load8(batch.shadow, mask);
+
+    __m256 diff = _mm256_max_ps(zero, dot8(lightDir, normal));
+    __m256 spec = pow8(_mm256_max_ps(zero, dot8(halfwayDir, normal)), shininess);
+    __m256 specular = _mm256_mul_ps(ks, spec);
+
+    for (int k = 0; k < 3; ++k)
+    {
+        __m256 diffuse =
+            _mm256_mul_ps(_mm256_mul_ps(load8(batch.albedo[k], mask), diff), ao);
+        __m256 radiance = _mm256_mul_ps(_mm256_add_ps(diffuse, specular),
+                                        load8(batch.radiance[k], mask));
+        _mm256_maskstore_ps(out[k], mask, _mm256_mul_ps(radiance, shadow));
+    }
+}
+
+LIGHTING_AVX2 static __m256 geometrySchlickGGX8(__m256 NdotV, __m256 k)
+{
+    __m256 denominator =
+        _mm256_add_ps(_mm256_mul_ps(NdotV, _mm256_sub_ps(set8(1.f), k)), k);
+    return _mm256_div_ps(NdotV, denominator);
+}
+
+LIGHTING_AVX2 static void cookTorranceAVX2(const Batch& batch, int count,
+                                           Float out[3][BatchSize])
+{
+    __m256i mask = laneMask8(count);
+
+    __m256 lightDir[3], viewDir[3], halfwayDir[3], normal[3];
+    load8(batch.lightDir, mask, lightDir);
+    load8(batch.viewDir, mask, viewDir);
+    load8(batch.halfwayDir, mask, halfwayDir);
+    load8(batch.normal, mask, normal);
+
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = set8(1.f);
+    __m256       metalness = load8(batch.param[1], mask);
+    __m256       roughness = load8(batch.param[2], mask);
+    __m256       shadow = load8(batch.shadow, mask);
+
+    __m256 NdotV = _mm256_max_ps(dot8(normal, viewDir), zero);
+    __m256 NdotL = _mm256_max_ps(dot8(normal, lightDir), zero);
+    __m256 NdotH = _mm256_max_ps(dot8(normal, halfwayDir), zero);
+    __m256 HdotV = _mm256_max_ps(dot8(halfwayDir, viewDir), zero);
+
+    // D (GGX)
+    __m256 a = _mm256_mul_ps(roughness, roughness);
+    __m256 a2 = _mm256_mul_ps(a, a);
+    __m256 NdotH2 = _mm256_mul_ps(NdotH, NdotH);
+    __m256 denominatorD =
+        _mm256_add_ps(_mm256_mul_ps(NdotH2, _mm256_sub_ps(a2, one)), one);
+    __m256 NDF = _mm256_div_ps(_mm256_mul_ps(a2, set8(InvPi)),
+                               _mm256_mul_ps(denominatorD, denominatorD));
+
+    // G (Smith)
+    __m256 r = _mm256_add_ps(roughness, one);
+    __m256 k = _mm256_div_ps(_mm256_mul_ps(r, r), set8(8.f));
+    __m256 G =
+        _mm256_mul_ps(geometrySchlickGGX8(NdotV, k), geometrySchlickGGX8(NdotL, k));
+
+    // F (Schlick)
+    __m256 oneMinusHdotV = _mm256_max_ps(_mm256_sub_ps(one, HdotV), zero);
+    __m256 oneMinusHdotV2 = _mm256_mul_ps(oneMinusHdotV, oneMinusHdotV);
+    __m256 fresnel =
+        _mm256_mul_ps(_mm256_mul_ps(oneMinusHdotV2, oneMinusHdotV2), oneMinusHdotV);
+
+    __m256 NDFxG = _mm256_mul_ps(NDF, G);
+    __m256 denominator = _mm256_mul_ps(_mm256_mul_ps(set8(4.f), NdotV), NdotL);
+    denominator = _mm256_add_ps(denominator, set8(0.001f));  // avoids division by zero
+    __m256 diffuseScale = _mm256_sub_ps(one, metalness);
+
+    for (int c = 0; c < 3; ++c)
+    {
+        __m256 albedo = load8(batch.albedo[c], mask);
+        __m256 F0 = _mm256_add_ps(_mm256_mul_ps(diffuseScale, set8(0.04f)),
+                                  _mm256_mul_ps(metalness, albedo));  // Lerp
+        __m256 F = _mm256_add_ps(F0, _mm256_mul_ps(_mm256_sub_ps(one, F0), fresnel));
+
+        __m256 specular = _mm256_div_ps(_mm256_mul_ps(NDFxG, F), denominator);
+        __m256 kd = _mm256_mul_ps(_mm256_sub_ps(one, F), diffuseScale);
+        __m256 brdf = _mm256_add_ps(
+            _mm256_mul_ps(_mm256_mul_ps(kd, albedo), set8(InvPi)), specular);
+        __m256 radiance =
+            _mm256_mul_ps(_mm256_mul_ps(brdf, load8(batch.radiance[c], mask)), NdotL);
+        _mm256_maskstore_ps(out[c], mask, _mm256_mul_ps(radiance, shadow));
+    }
+}
+
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////
+
+using KernelFunc = void (*)(const Batch&, int, Float[3][BatchSize]);
+
+struct Kernel
+{
+    KernelFunc  blinnPhong;
+    KernelFunc  cookTorrance;
+    const char* name;
+};
+
+static Kernel selectKernel()
+{
+#ifdef LIGHTING_KERNEL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return { blinnPhongAVX2, cookTorranceAVX2, "AVX2" };
+#endif
+    return { blinnPhongScalar, cookTorranceScalar, "Scalar" };
+}
+
+static const Kernel s_Kernel = selectKernel();
+
+const char* GetName()
+{
+    return s_Kernel.name;
+}
+
+void BlinnPhong(const Batch& batch, int count, Float out[3][BatchSize])
+{
+    s_Kernel.blinnPhong(batch, count, out);
+}
+
+void CookTorrance(const Batch& batch, int count, Float out[3][BatchSize])
+{
+    s_Kernel.cookTorrance(batch, count, out);
+}
+
+}  // namespace LightingKernel
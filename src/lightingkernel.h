@@ -0,0 +1,31 @@
+#pragma once
+
+#include "constant.h"
+
+// Direct Lighting Kernels For The Deferred Lighting Pass
+// A batch of texels lit by one point light, stored as arrays of 8 lanes per component.
+// AVX2 (8 texels) / Scalar, selected at runtime by CPUID
+namespace LightingKernel
+{
+static const int BatchSize = 8;
+
+// Directions are normalized, colors are in linear space
+struct Batch
+{
+    Float lightDir[3][BatchSize];
+    Float viewDir[3][BatchSize];
+    Float halfwayDir[3][BatchSize];
+    Float normal[3][BatchSize];
+    Float albedo[3][BatchSize];
+    Float param[3][BatchSize];     // ao, ks, shininess (PBR: ao, metalness, roughness)
+    Float radiance[3][BatchSize];  // light color * attenuation
+    Float shadow[BatchSize];       // scale of the direct light (1 if not shadowed)
+};
+
+const char* GetName();
+
+// Outgoing radiance of texels [0, count) of the batch, as CalculateRadiance() of the
+// shaders times the shadow scale. Lanes past count are neither read nor written.
+void BlinnPhong(const Batch& batch, int count, Float out[3][BatchSize]);
+void CookTorrance(const Batch& batch, int count, Float out[3][BatchSize]);
+}  // namespace LightingKernel
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+#include "geometry.h"
+#include "material.h"
+#include "pbrmaterial.h"
+#include "texture.h"
+
+// Material resolved once per draw for the fragment shaders: raw texture pointers,
+// constant factors and has-map bits. Textures stay owned by Model.
+struct BoundMaterial
+{
+    enum MapBits : uint32_t
+    {
+        DiffuseMap = 1u << 0,
+        SpecularMap = 1u << 1,
+        NormalMap = 1u << 2,
+        EmissiveMap = 1u << 3,
+        BaseColorMap = 1u << 4,
+        RoughnessMap = 1u << 5,
+        MetalnessMap = 1u << 6,
+        AmbientOcclusionMap = 1u << 7
+    };
+
+    uint32_t mapBits = 0;
+
+    // Blinn-Phong
+    Vector3f ka;
+    Vector3f kd;
+    Vector3f ks;
+    Vector3f ke;  // shared with PBR
+
+    // PBR
+    Vector3f albedo;
+    Float    roughness = 0.f;
+    Float    metalness = 0.f;
+
+    const Texture* diffuseMap = nullptr;
+    const Texture* specularMap = nullptr;
+    const Texture* normalMap = nullptr;  // shared with PBR
+    const Texture* emissiveMap = nullptr;  // shared with PBR
+    const Texture* baseColorMap = nullptr;
+    const Texture* roughnessMap = nullptr;
+    const Texture* metalnessMap = nullptr;
+    const Texture* ambientOcclusionMap = nullptr;
+
+    inline bool Has(MapBits bits) const { return (mapBits & bits) != 0; }
+
+    // Either material can be null
+    static BoundMaterial Resolve(const Material* material, const PBRMaterial* pbrMaterial)
+    {
+        BoundMaterial bound;
+        if (material)
+        {
+            bound.ka = material->ka;
+            bound.kd = material->kd;
+            bound.ks = material->ks;
+            bound.ke = material->ke;
+            bound.Bind(material->diffuseMap.get(), DiffuseMap, bound.diffuseMap);
+            bound.Bind(material->specularMap.get(), SpecularMap, bound.specularMap);
+            bound.Bind(material->normalMap.get(), NormalMap, bound.normalMap);
+            bound.Bind(material->emissiveMap.get(), EmissiveMap, bound.emissiveMap);
+        }
+        if (pbrMaterial)
+        {
+            bound.albedo = pbrMaterial->albedo;
+            bound.roughness = pbrMaterial->roughness;
+            bound.metalness = pbrMaterial->metalness;
+            bound.Bind(pbrMaterial->baseColorMap.get(), BaseColorMap, bound.baseColorMap);
+            bound.Bind(pbrMaterial->roughnessMap.get(), RoughnessMap, bound.roughnessMap);
+            bound.Bind(pbrMaterial->metalnessMap.get(), MetalnessMap, bound.metalnessMap);
+            bound.Bind(pbrMaterial->ambientOcclusionMap.get(), AmbientOcclusionMap,
+                       bound.ambientOcclusionMap);
+            if (!material)  // both are loaded from the same *.mtl entry
+            {
+                bound.ke = pbrMaterial->ke;
+                bound.Bind(pbrMaterial->normalMap.get(), NormalMap, bound.normalMap);
+                bound.Bind(pbrMaterial->emissiveMap.get(), EmissiveMap, bound.emissiveMap);
+            }
+        }
+        return bound;
+    }
+
+private:
+    void Bind(const Texture* texture, MapBits bit, const Texture*& slot)
+    {
+        slot = texture;
+        if (texture) mapBits |= bit;
+    }
+};
+
+// Vectors have checked copy constructors in debug builds (see geometry.h)
+#ifdef NDEBUG
+static_assert(std::is_trivially_copyable<BoundMaterial>::value,
+              "BoundMaterial is copied with every recorded draw context");
+#endif
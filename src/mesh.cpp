@@ -4,24 +4,58 @@
 
 #include "mesh.h"
 
+#include <map>
+#include <tuple>
+
 #include "forkergl.h"
 #include "shader.h"
 
-void Mesh::Draw(Shader& shader) const
+// Transformed Vertex Buffers (per-thread arena, reused by every draw)
+static thread_local std::vector<Point4f> s_ClipCoords;
+static thread_local std::vector<Float>   s_Varyings;
+
+void Mesh::Draw(const Shader& shader) const
 {
-    // For each face
-    for (int f = 0; f < NumFaces(); ++f)
+    // Per-draw state, read by the shader stages (alive until Flush() returns)
+    DrawContext context;
+    context.mesh = this;
+    context.material = BindMaterial();
+    context.hasTangents = m_Model.HasTangents();
+    context.supportPBR = m_Model.SupportPBR();
+    context.drawId = -1;
+    ForkerGL::RecordDraw(context, shader);
+
+    // Vertex Processing (once per unique vertex)
+    int numUniqueVerts = NumUniqueVerts();
+    int numVaryings = shader.GetVaryingCount();
+    s_ClipCoords.resize(numUniqueVerts);
+    s_Varyings.resize(numUniqueVerts * numVaryings);
+
+    for (int u = 0; u < numUniqueVerts; ++u)
     {
-        // Use Shader To Set Mesh Pointer
-        shader.Use(shared_from_this());
+        int f = m_UniqueVertCorners[u] / 3;
+        int v = m_UniqueVertCorners[u] % 3;
+        s_ClipCoords[u] =
+            shader.ProcessVertex(context, f, v, s_Varyings.data() + u * numVaryings);
+    }
 
-        Point4f ndcCoords[3];
+    // Primitive Assembly (triangles refer to the varyings in the vertex buffer)
+    for (int f = 0; f < NumFaces(); ++f)
+    {
+        Point4f          clipCoords[3];
+        TriangleVaryings varyings;
         for (int v = 0; v < 3; ++v)  // for each vertex
         {
-            ndcCoords[v] = shader.ProcessVertex(f, v);
+            int u = m_FaceUniqueVertIndices[f * 3 + v];
+            clipCoords[v] = s_ClipCoords[u];
+            varyings.vertices[v] = s_Varyings.data() + u * numVaryings;
         }
-        ForkerGL::DrawTriangle(ndcCoords, shader);
+        // Culled, clipped and binned
+        ForkerGL::DrawTriangle(clipCoords, varyings, context, shader, f);
     }
+
+    // Rasterize binned triangles
+    ForkerGL::Flush();
 }
 
 /////////////////////////////////////////////////////////////////////////////////
@@ -60,6 +94,31 @@ int Mesh::GetVertIndex(int faceIdx, int vertIdx) const
     return m_FaceVertIndices[faceIdx * 3 + vertIdx];
 }
 
+void Mesh::BuildUniqueVerts()
+{
+    using VertKey = std::tuple<int, int, int, int>;
+    std::map<VertKey, int> uniqueIndices;
+
+    bool hasTangents = !m_FaceTangentIndices.empty();
+
+    m_FaceUniqueVertIndices.clear();
+    m_UniqueVertCorners.clear();
+    for (int corner = 0; corner < (int)m_FaceVertIndices.size(); ++corner)
+    {
+        VertKey key(m_FaceVertIndices[corner], m_FaceTexCoordIndices[corner],
+                    m_FaceNormalIndices[corner],
+                    hasTangents ? m_FaceTangentIndices[corner] : -1);
+
+        auto iter = uniqueIndices.find(key);
+        if (iter == uniqueIndices.end())
+        {
+            iter = uniqueIndices.emplace(key, (int)m_UniqueVertCorners.size()).first;
+            m_UniqueVertCorners.push_back(corner);
+        }
+        m_FaceUniqueVertIndices.push_back(iter->second);
+    }
+}
+
 /////////////////////////////////////////////////////////////////////////////////
 
 void Mesh::AddVertIndex(int index)
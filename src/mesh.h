@@ -6,13 +6,14 @@
 
 #include <memory>
 
+#include "boundmaterial.h"
 #include "color.h"
 #include "geometry.h"
 #include "material.h"
 #include "pbrmaterial.h"
 #include "tgaimage.h"
 
-class Shader;
+struct Shader;
 class Model;
 
 class Mesh : public std::enable_shared_from_this<Mesh>
@@ -24,7 +25,7 @@ public:
     explicit Mesh(const Mesh& m) = delete;
 
     // Model will call it in its Render()
-    void Draw(Shader& shader) const;
+    void Draw(const Shader& shader) const;
 
     // Vertex Properties
     int      NumFaces() const;
@@ -34,6 +35,11 @@ public:
     Vector3f Tangent(int faceIdx, int vertIdx) const;
     int      GetVertIndex(int faceIdx, int vertIdx) const;
 
+    // Indexed Draw: faces share unique (position, texcoord, normal, tangent) vertices,
+    // which are processed by the vertex shader once per draw
+    void BuildUniqueVerts();  // called by Model after loading
+    int  NumUniqueVerts() const { return (int)m_UniqueVertCorners.size(); }
+
     // Helper
     const Model&                       GetModel() const { return m_Model; }
     std::shared_ptr<const Material>    GetMaterial() const { return m_Material.lock(); };
@@ -42,6 +48,11 @@ public:
         return m_PBRMaterial.lock();
     }
 
+    BoundMaterial BindMaterial() const  // once per draw, not per fragment
+    {
+        return BoundMaterial::Resolve(GetMaterial().get(), GetPBRMaterial().get());
+    }
+
     void SetMaterial(std::shared_ptr<const Material> m) { m_Material = m; }
     void SetPBRMaterial(std::shared_ptr<const PBRMaterial> m) { m_PBRMaterial = m; }
 
@@ -61,4 +72,7 @@ private:
     std::vector<int> m_FaceTexCoordIndices;
     std::vector<int> m_FaceNormalIndices;  // 3 vertices form a triangle
     std::vector<int> m_FaceTangentIndices;
+
+    std::vector<int> m_FaceUniqueVertIndices;  // 3 per face
+    std::vector<int> m_UniqueVertCorners;      // first use (faceIdx * 3 + vertIdx)
 };
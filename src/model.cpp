@@ -46,6 +46,10 @@ std::unique_ptr<Model> Model::Load(const std::string& filename, bool normalized,
     // Post-Processing
     if (generateTangent) model->generateTangents();
     if (normalized) model->normalizePositionVertices();
+    for (auto iter = model->m_Meshes.begin(); iter != model->m_Meshes.end(); ++iter)
+    {
+        iter->second->BuildUniqueVerts();
+    }
 
     // clang-format off
     spdlog::info(
@@ -62,12 +66,12 @@ std::unique_ptr<Model> Model::Load(const std::string& filename, bool normalized,
         if (pbrMaterial->HasMetalnessMap() || pbrMaterial->HasRoughnessMap())
         {
             model->m_SupportPBR = true;
-            spdlog::info("     [{:}] f# {:} | PBR[o] {}", iter->first, mesh.NumFaces(), *pbrMaterial);
+            spdlog::info("     [{:}] f# {:}, verts# {:} | PBR[o] {}", iter->first, mesh.NumFaces(), mesh.NumUniqueVerts(), *pbrMaterial);
         }
         else
         {
             model->m_SupportPBR = false;
-            spdlog::info("     [{:}] f# {:} | PBR[x] {}", iter->first, mesh.NumFaces(), *(mesh.GetMaterial()));
+            spdlog::info("     [{:}] f# {:}, verts# {:} | PBR[x] {}", iter->first, mesh.NumFaces(), mesh.NumUniqueVerts(), *(mesh.GetMaterial()));
         }
     }
     // clang-format on
@@ -78,7 +82,7 @@ std::unique_ptr<Model> Model::Load(const std::string& filename, bool normalized,
 
 /////////////////////////////////////////////////////////////////////////////////
 
-void Model::Render(Shader& shader) const
+void Model::Render(const Shader& shader) const
 {
     spdlog::stopwatch stopwatch;
     // For each mesh
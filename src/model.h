@@ -31,7 +31,7 @@ public:
     explicit Model(const Model& m) = delete;
 
     // Starts Rendering This Fun Stuff!
-    void Render(Shader& shader) const;
+    void Render(const Shader& shader) const;
 
     // Get Vertex Data
     Vector3f GetVert(int index) const { return m_Verts[index]; }
@@ -0,0 +1,175 @@
+#include "rasterkernel.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__)) && !defined(FLOAT_AS_DOUBLE)
+#define RASTER_KERNEL_X86
+#include <immintrin.h>
+#endif
+
+// Edge values are integers (up to ~2^42 with large guard bands), so they are tested as
+// doubles, which represent them exactly.
+
+namespace RasterKernel
+{
+
+static uint32_t coverageDepthTestScalar(const Span& span, const Float* depthRow,
+                                        int count, DepthTest depthTest, Float* depthOut)
+{
+    uint32_t mask = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        if (span.e[0] + i * span.step[0] < 0.0 || span.e[1] + i * span.step[1] < 0.0 ||
+            span.e[2] + i * span.step[2] < 0.0)
+            continue;
+
+        Float z = span.z + (Float)i * span.zStep;
+        depthOut[i] = z;
+        bool  passed = (depthTest == Less) ? z < depthRow[i] : z == depthRow[i];
+        if (passed) mask |= 1u << i;
+    }
+    return mask;
+}
+
+#ifdef RASTER_KERNEL_X86
+
+__attribute__((target("avx2"))) static uint32_t coverageDepthTestAVX2(
+    const Span& span, const Float* depthRow, int count, DepthTest depthTest,
+    Float* depthOut)
+{
+    const __m256d laneLo = _mm256_set_pd(3.0, 2.0, 1.0, 0.0);
+    const __m256d laneHi = _mm256_set_pd(7.0, 6.0, 5.0, 4.0);
+    const __m256d zero = _mm256_setzero_pd();
+
+    // Coverage
+    int mask = (1 << count) - 1;
+    for (int k = 0; k < 3; ++k)
+    {
+        __m256d e = _mm256_set1_pd(span.e[k]);
+        __m256d step = _mm256_set1_pd(span.step[k]);
+        __m256d lo = _mm256_add_pd(e, _mm256_mul_pd(laneLo, step));
+        __m256d hi = _mm256_add_pd(e, _mm256_mul_pd(laneHi, step));
+        int     inside = _mm256_movemask_pd(_mm256_cmp_pd(lo, zero, _CMP_GE_OQ)) |
+                     (_mm256_movemask_pd(_mm256_cmp_pd(hi, zero, _CMP_GE_OQ)) << 4);
+        mask &= inside;
+    }
+    if (mask == 0) return 0;
+
+    // Depth
+    __m256 lanes = _mm256_set_ps(7.f, 6.f, 5.f, 4.f, 3.f, 2.f, 1.f, 0.f);
+    __m256 z = _mm256_add_ps(_mm256_set1_ps(span.z),
+                             _mm256_mul_ps(lanes, _mm256_set1_ps(span.zStep)));
+    __m256 stored;
+    if (count == 8)
+    {
+        stored = _mm256_loadu_ps(depthRow);
+    }
+    else  // do not read past the end of the row
+    {
+        alignas(32) Float partial[8] = { 0.f };
+        for (int i = 0; i < count; ++i)
+            partial[i] = depthRow[i];
+        stored = _mm256_load_ps(partial);
+    }
+
+    alignas(32) Float depths[8];
+    _mm256_store_ps(depths, z);
+    for (int i = 0; i < count; ++i)
+        depthOut[i] = depths[i];
+
+    __m256 passed = (depthTest == Less) ? _mm256_cmp_ps(z, stored, _CMP_LT_OQ)
+                                        : _mm256_cmp_ps(z, stored, _CMP_EQ_OQ);
+    mask &= _mm256_movemask_ps(passed);
+    return (uint32_t)mask;
+}
+
+static uint32_t coverageDepthTestSSE(const Span& span, const Float* depthRow, int count,
+                                     DepthTest depthTest, Float* depthOut)
+{
+    const __m128d laneLo = _mm_set_pd(1.0, 0.0);
+    const __m128d laneHi = _mm_set_pd(3.0, 2.0);
+    const __m128d zero = _mm_setzero_pd();
+
+    // Coverage
+    int mask = (1 << count) - 1;
+    for (int k = 0; k < 3; ++k)
+    {
+        __m128d e = _mm_set1_pd(span.e[k]);
+        __m128d step = _mm_set1_pd(span.step[k]);
+        __m128d lo = _mm_add_pd(e, _mm_mul_pd(laneLo, step));
+        __m128d hi = _mm_add_pd(e, _mm_mul_pd(laneHi, step));
+        int     inside = _mm_movemask_pd(_mm_cmpge_pd(lo, zero)) |
+                     (_mm_movemask_pd(_mm_cmpge_pd(hi, zero)) << 2);
+        mask &= inside;
+    }
+    if (mask == 0) return 0;
+
+    // Depth
+    __m128 lanes = _mm_set_ps(3.f, 2.f, 1.f, 0.f);
+    __m128 z =
+        _mm_add_ps(_mm_set1_ps(span.z), _mm_mul_ps(lanes, _mm_set1_ps(span.zStep)));
+    __m128 stored;
+    if (count == 4)
+    {
+        stored = _mm_loadu_ps(depthRow);
+    }
+    else  // do not read past the end of the row
+    {
+        alignas(16) Float partial[4] = { 0.f };
+        for (int i = 0; i < count; ++i)
+            partial[i] = depthRow[i];
+        stored = _mm_load_ps(partial);
+    }
+
+    alignas(16) Float depths[4];
+    _mm_store_ps(depths, z);
+    for (int i = 0; i < count; ++i)
+        depthOut[i] = depths[i];
+
+    __m128 passed =
+        (depthTest == Less) ? _mm_cmplt_ps(z, stored) : _mm_cmpeq_ps(z, stored);
+    mask &= _mm_movemask_ps(passed);
+    return (uint32_t)mask;
+}
+
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////
+
+using KernelFunc = uint32_t (*)(const Span&, const Float*, int, DepthTest, Float*);
+
+struct Kernel
+{
+    KernelFunc  func;
+    int         laneCount;
+    const char* name;
+};
+
+static Kernel selectKernel()
+{
+#ifdef RASTER_KERNEL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return { coverageDepthTestAVX2, 8, "AVX2" };
+    if (__builtin_cpu_supports("sse2")) return { coverageDepthTestSSE, 4, "SSE2" };
+#endif
+    return { coverageDepthTestScalar, 8, "Scalar" };
+}
+
+static const Kernel s_Kernel = selectKernel();
+
+int GetLaneCount()
+{
+    return s_Kernel.laneCount;
+}
+
+const char* GetName()
+{
+    return s_Kernel.name;
+}
+
+uint32_t CoverageDepthTest(const Span& span, const Float* depthRow, int count,
+                           DepthTest depthTest, Float* depthOut)
+{
+    return s_Kernel.func(span, depthRow, count, depthTest, depthOut);
+}
+
+}  // namespace RasterKernel
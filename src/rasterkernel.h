@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+
+#include "constant.h"
+
+// Coverage & Depth Test Kernels For The Rasterizer Inner Loop
+// AVX2 (8 pixels) / SSE2 (4 pixels) / Scalar, selected at runtime by CPUID
+namespace RasterKernel
+{
+enum DepthTest
+{
+    Less,
+    Equal
+};
+
+// A run of pixels on one row
+struct Span
+{
+    double e[3];     // edge values at the first pixel (fill rule bias included)
+    double step[3];  // edge increments per pixel
+    Float  z;        // depth at the first pixel
+    Float  zStep;    // depth increment per pixel
+};
+
+// Number of pixels tested at a time
+int         GetLaneCount();
+const char* GetName();
+
+// Tests pixels [0, count) of the span (count <= lane count) against the edges and
+// depthRow. Interpolated depths are written to depthOut and a bit is set in the returned
+// mask for each pixel that survives.
+uint32_t CoverageDepthTest(const Span& span, const Float* depthRow, int count,
+                           DepthTest depthTest, Float* depthOut);
+}  // namespace RasterKernel
@@ -6,6 +6,9 @@
 
 #include <spdlog/spdlog.h>
 
+#include <memory>
+#include <vector>
+
 static const Float s_ShadowViewSize = 3.0f;
 static const Float s_ShadowNearPlane = 0.1f;
 static const Float s_ShadowFarPlane = 20.f;
@@ -15,6 +18,15 @@ static const Float s_CameraFarPlane = 20.f;
 
 static spdlog::stopwatch stepStopwatch;
 
+static LightClusters s_LightClusters;  // forward shading of the other point lights
+
+// Shaders of the visibility pass draws, kept until the visible pixels are shaded
+static std::vector<std::unique_ptr<Shader>> s_VisibilityShaders;
+
+// Edge supersampling targets, reused across frames
+static Buffer1f s_EdgeMask;
+static Buffer3f s_EdgeAccumulation;
+
 namespace Render
 {
 
@@ -47,6 +59,12 @@ void Render(const Scene& scene)
     {
         DoForwardPass(scene);
     }
+    // Visibility Buffer Rendering
+    else if (ForkerGL::GetRenderMode() == ForkerGL::Visibility)
+    {
+        DoVisibilityPass(scene);
+        DoVisibilityShadingPass(scene);
+    }
     // Deferred Rendering
     else
     {
@@ -54,9 +72,20 @@ void Render(const Scene& scene)
         DoLightingPass(scene);
     }
     // Anti-Aliasing
+    DoEdgeSSAA(scene);
     DoSSAA(scene);
 }
 
+// Culling statistics of the triangles submitted since the last reset
+static void LogTriangleStats()
+{
+    const ForkerGL::TriangleStats& stats = ForkerGL::GetTriangleStats();
+    spdlog::info("  [Triangles] submitted: {}, face culled: {}, frustum culled: {}, "
+                 "degenerate: {}, clipped: {}",
+                 stats.submitted, stats.faceCulled, stats.frustumCulled, stats.degenerate,
+                 stats.clipped);
+}
+
 void DoShadowPass(const Scene& scene)
 {
     spdlog::info("Shadow Pass:");
@@ -68,6 +97,7 @@ void DoShadowPass(const Scene& scene)
         ForkerGL::InitShadowBuffer(GetWidth(scene), GetHeight(scene));
         ForkerGL::InitDepthBuffer(GetWidth(scene), GetHeight(scene));
         ForkerGL::SetPassType(ForkerGL::ShadowPass);
+        ForkerGL::ResetTriangleStats();
 
         // Matrix
         Matrix4x4f viewMatrixSM =
@@ -88,6 +118,7 @@ void DoShadowPass(const Scene& scene)
             // Render
             model.Render(depthShader);
         }
+        LogTriangleStats();
     }
     else
     {
@@ -96,6 +127,79 @@ void DoShadowPass(const Scene& scene)
     TimeElapsed(stepStopwatch, "Shadow Pass");
 }
 
+// Forward shader of one model (also used by the depth pre-pass and the visibility
+// buffer)
+static std::unique_ptr<Shader> MakeForwardShader(const Scene& scene, int index,
+                                                 const Matrix4x4f&    viewMatrix,
+                                                 const Matrix4x4f&    projectionMatrix,
+                                                 const LightClusters* lightClusters)
+{
+    const auto& model = scene.GetModel(index);
+
+    if (!model.SupportPBR())
+    {
+        // Blinn-Phong Shading
+        auto bpShader = std::make_unique<BlinnPhongShader>();
+        bpShader->uModelMatrix = scene.GetModelMatrix(index);
+        bpShader->uViewMatrix = viewMatrix;
+        bpShader->uProjectionMatrix = projectionMatrix;
+        bpShader->uNormalMatrix = MakeNormalMatrix(bpShader->uModelMatrix);
+        // Shader Configuration
+        bpShader->uPointLight = scene.GetPointLight();
+        bpShader->uEyePos = scene.GetCamera().GetPosition();
+        bpShader->uLightClusters = lightClusters;
+        if (Shadow::GetShadowStatus())
+            bpShader->uLightSpaceMatrix = ForkerGL::GetLightSpaceMatrix();
+        return bpShader;
+    }
+    else
+    {
+        // PBR Shading
+        auto pbrShader = std::make_unique<PBRShader>();
+        pbrShader->uModelMatrix = scene.GetModelMatrix(index);
+        pbrShader->uViewMatrix = viewMatrix;
+        pbrShader->uProjectionMatrix = projectionMatrix;
+        pbrShader->uNormalMatrix = MakeNormalMatrix(pbrShader->uModelMatrix);
+        // Shader Configuration
+        pbrShader->uPointLight = scene.GetPointLight();
+        pbrShader->uEyePos = scene.GetCamera().GetPosition();
+        pbrShader->uLightClusters = lightClusters;
+        if (Shadow::GetShadowStatus())
+            pbrShader->uLightSpaceMatrix = ForkerGL::GetLightSpaceMatrix();
+        return pbrShader;
+    }
+}
+
+static void DrawForwardModel(const Scene& scene, int index, const Matrix4x4f& viewMatrix,
+                             const Matrix4x4f& projectionMatrix,
+                             const LightClusters* lightClusters)
+{
+    std::unique_ptr<Shader> shader =
+        MakeForwardShader(scene, index, viewMatrix, projectionMatrix, lightClusters);
+    scene.GetModel(index).Render(*shader);
+}
+
+// Clustered Forward Shading: point lights other than the shadowed one are assigned to
+// the froxels of the view frustum once per frame (nullptr with a single light)
+static const LightClusters* BuildLightClusters(const Scene&      scene,
+                                               const Matrix4x4f& viewMatrix,
+                                               const Matrix4x4f& projectionMatrix)
+{
+    if (scene.GetPointLightCount() <= 1) return nullptr;
+
+    s_LightClusters.Build(scene.GetPointLights(), viewMatrix, projectionMatrix,
+                          ForkerGL::GetViewportMatrix(), s_CameraNearPlane,
+                          s_CameraFarPlane);
+    spdlog::info("Light Clusters:");
+    spdlog::info("  [Clusters] {} x {} x {} froxels, other lights: {}, per froxel: "
+                 "{:.1f}",
+                 s_LightClusters.GetNumTilesX(), s_LightClusters.GetNumTilesY(),
+                 LightClusters::NumSlices, s_LightClusters.GetLightCount(),
+                 s_LightClusters.GetAverageClusterLightCount());
+    TimeElapsed(stepStopwatch, "Light Clusters");
+    return &s_LightClusters;
+}
+
 void DoForwardPass(const Scene& scene)
 {
     ForkerGL::InitFrameBuffer(GetWidth(scene), GetHeight(scene));
@@ -114,53 +218,93 @@ void DoForwardPass(const Scene& scene)
                                                      s_CameraFarPlane);
     ForkerGL::SetViewProjectionMatrix(projectionMatrix * viewMatrix);
 
-    for (int i = 0; i < scene.GetModelCount(); ++i)
-    {
-        const auto& model = scene.GetModel(i);
+    const LightClusters* lightClusters =
+        BuildLightClusters(scene, viewMatrix, projectionMatrix);
 
-        if (!model.SupportPBR())
+    // Depth Pre-Pass: the same shaders produce bitwise identical depths, so the shading
+    // pass below only shades the visible fragment of each pixel (equal depth test)
+    long long prePassFragmentCount = 0;
+    if (scene.IsDepthPrePassOn())
+    {
+        spdlog::info("Depth Pre-Pass:");
+        ForkerGL::SetPassType(ForkerGL::DepthPrePass);
+        ForkerGL::ResetFragmentCount();
+        ForkerGL::ResetTriangleStats();
+        for (int i = 0; i < (int)scene.GetModelCount(); ++i)
         {
-            // Blinn-Phong Shading
-            spdlog::info("Forward Pass (Blinn-Phong):");
-            BlinnPhongShader bpShader;
-            bpShader.uModelMatrix = scene.GetModelMatrix(i);
-            bpShader.uViewMatrix = viewMatrix;
-            bpShader.uProjectionMatrix = projectionMatrix;
-            bpShader.uNormalMatrix = MakeNormalMatrix(bpShader.uModelMatrix);
-            // Shader Configuration
-            bpShader.uPointLight = scene.GetPointLight();
-            bpShader.uEyePos = scene.GetCamera().GetPosition();
-            if (Shadow::GetShadowStatus())
-                bpShader.uLightSpaceMatrix = ForkerGL::GetLightSpaceMatrix();
-            // Render
-            model.Render(bpShader);
+            DrawForwardModel(scene, i, viewMatrix, projectionMatrix, lightClusters);
         }
+        LogTriangleStats();
+        prePassFragmentCount = ForkerGL::GetFragmentCount();
+        TimeElapsed(stepStopwatch, "Depth Pre-Pass");
+
+        ForkerGL::SetPassType(ForkerGL::ForwardPass);
+        ForkerGL::SetDepthFunc(ForkerGL::Equal);
+    }
+
+    ForkerGL::ResetFragmentCount();
+    ForkerGL::ResetTriangleStats();
+    for (int i = 0; i < (int)scene.GetModelCount(); ++i)
+    {
+        if (!scene.GetModel(i).SupportPBR())
+            spdlog::info("Forward Pass (Blinn-Phong):");
         else
-        {
-            // PBR Shading
             spdlog::info("Forward Pass (PBR):");
-            PBRShader pbrShader;
-            pbrShader.uModelMatrix = scene.GetModelMatrix(i);
-            pbrShader.uViewMatrix = viewMatrix;
-            pbrShader.uProjectionMatrix = projectionMatrix;
-            pbrShader.uNormalMatrix = MakeNormalMatrix(pbrShader.uModelMatrix);
-            // Shader Configuration
-            pbrShader.uPointLight = scene.GetPointLight();
-            pbrShader.uEyePos = scene.GetCamera().GetPosition();
-            if (Shadow::GetShadowStatus())
-                pbrShader.uLightSpaceMatrix = ForkerGL::GetLightSpaceMatrix();
-            // Render
-            model.Render(pbrShader);
-        }
+        DrawForwardModel(scene, i, viewMatrix, projectionMatrix, lightClusters);
+    }
+    ForkerGL::SetDepthFunc(ForkerGL::Less);
+    LogTriangleStats();
+    ForkerGL::ResolveDepthClears();  // for the z-buffer output
+
+    // MSAA Resolve
+    if (ForkerGL::GetSampleCount() > 1)
+    {
+        ForkerGL::ResolveFrameBuffer();
+        ForkerGL::ResolveDepthBuffer();
+        spdlog::info("  [MSAA] resolved {} samples per pixel",
+                     ForkerGL::GetSampleCount());
+    }
+
+    // Fragments shaded without the pre-pass = fragments that passed its less test
+    long long shadedCount = ForkerGL::GetFragmentCount();
+    if (scene.IsDepthPrePassOn())
+    {
+        long long eliminated = prePassFragmentCount - shadedCount;
+        spdlog::info("  [Depth Pre-Pass] shaded fragments: {} / {} (overdraw eliminated: "
+                     "{}, {:.1f}%)",
+                     shadedCount, prePassFragmentCount, eliminated,
+                     prePassFragmentCount > 0 ? 100.0 * eliminated / prePassFragmentCount
+                                              : 0.0);
+    }
+    else
+    {
+        spdlog::info("  [Fragments] shaded: {}", shadedCount);
     }
     TimeElapsed(stepStopwatch, "Forward Pass");
 }
 
+// Geometry pass of one model (also used by edge supersampling)
+static void DrawGeometryModel(const Scene& scene, int index, const Matrix4x4f& viewMatrix,
+                              const Matrix4x4f& projectionMatrix)
+{
+    const auto& model = scene.GetModel(index);
+
+    GShader geometryShader;
+    geometryShader.uModelMatrix = scene.GetModelMatrix(index);
+    geometryShader.uViewMatrix = viewMatrix;
+    geometryShader.uProjectionMatrix = projectionMatrix;
+    geometryShader.uNormalMatrix = MakeNormalMatrix(geometryShader.uModelMatrix);
+    geometryShader.uLightSpaceMatrix = ForkerGL::GetLightSpaceMatrix();
+    // Render
+    model.Render(geometryShader);
+}
+
 void DoGeometryPass(const Scene& scene)
 {
     ForkerGL::InitGeometryBuffers(GetWidth(scene), GetHeight(scene));
     ForkerGL::InitDepthBuffer(GetWidth(scene), GetHeight(scene));
     ForkerGL::SetPassType(ForkerGL::GeometryPass);
+    ForkerGL::ResetTriangleStats();
 
     Float             ratio = scene.GetRatio();
     const Matrix4x4f& viewMatrix = scene.GetCamera().GetViewMatrix();
@@ -176,19 +320,19 @@ void DoGeometryPass(const Scene& scene)
 
     for (int i = 0; i < scene.GetModelCount(); ++i)
     {
-        const auto& model = scene.GetModel(i);
-
-        // Geometry Pass
         spdlog::info("Geometry Pass (Deferred):");
-        GShader geometryShader;
-        geometryShader.uModelMatrix = scene.GetModelMatrix(i);
-        geometryShader.uViewMatrix = viewMatrix;
-        geometryShader.uProjectionMatrix = projectionMatrix;
-        geometryShader.uNormalMatrix = MakeNormalMatrix(geometryShader.uModelMatrix);
-        geometryShader.uLightSpaceMatrix = ForkerGL::GetLightSpaceMatrix();
-        // Render
-        model.Render(geometryShader);
+        DrawGeometryModel(scene, i, viewMatrix, projectionMatrix);
     }
+    LogTriangleStats();
+
+    bool packed = ForkerGL::GetGBufferFormat() == ForkerGL::Packed;
+    int  texelSize = packed ? (int)sizeof(PackedGBufferTexel)
+                            : (Shadow::GetShadowStatus() ? 19 : 16) * (int)sizeof(Float);
+    spdlog::info("  [G-Buffer] format: {}, {} bytes per sample",
+                 packed ? "packed" : "full", texelSize);
+
+    // SSAO reads the depths of the first G-buffer sample plane
+    ForkerGL::ResolveDepthBuffer();
     TimeElapsed(stepStopwatch, "Geometry Pass");
 }
 
@@ -206,11 +350,74 @@ void DoLightingPass(const Scene& scene)
         DoSSAO(scene);
     }
 
+    // Kept for the edge pixels of edge SSAA
+    ForkerGL::BuildTileLights(scene);
     ForkerGL::DrawScreenSpacePixels(scene);
 
     TimeElapsed(stepStopwatch, "Lighting Pass");
 }
 
+void DoVisibilityPass(const Scene& scene)
+{
+    ForkerGL::InitFrameBuffer(GetWidth(scene), GetHeight(scene));
+    ForkerGL::InitDepthBuffer(GetWidth(scene), GetHeight(scene));
+    ForkerGL::ClearColor(Color3(0.12f, 0.12f, 0.12f));
+    ForkerGL::SetPassType(ForkerGL::VisibilityPass);
+    ForkerGL::InitVisibilityBuffer(GetWidth(scene), GetHeight(scene));
+
+    Float             ratio = scene.GetRatio();
+    const Matrix4x4f& viewMatrix = scene.GetCamera().GetViewMatrix();
+    const Matrix4x4f& projectionMatrix =
+        (scene.GetProjectionType() == Camera::Orthographic)
+            ? scene.GetCamera().GetOrthographicMatrix(-1.f * ratio, 1.f * ratio, -1.f,
+                                                      1.f, s_CameraNearPlane,
+                                                      s_CameraFarPlane)
+            : scene.GetCamera().GetPerspectiveMatrix(45.f, ratio, s_CameraNearPlane,
+                                                     s_CameraFarPlane);
+    ForkerGL::SetViewProjectionMatrix(projectionMatrix * viewMatrix);
+
+    const LightClusters* lightClusters =
+        BuildLightClusters(scene, viewMatrix, projectionMatrix);
+
+    // Only depth and the ids are written here, so hidden fragments cost no attribute
+    // interpolation, texture sampling or G-buffer writes
+    s_VisibilityShaders.clear();
+    ForkerGL::ResetFragmentCount();
+    ForkerGL::ResetTriangleStats();
+    for (int i = 0; i < (int)scene.GetModelCount(); ++i)
+    {
+        spdlog::info("Visibility Pass:");
+        s_VisibilityShaders.push_back(
+            MakeForwardShader(scene, i, viewMatrix, projectionMatrix, lightClusters));
+        scene.GetModel(i).Render(*s_VisibilityShaders.back());
+    }
+    LogTriangleStats();
+    spdlog::info("  [Fragments] rasterized: {}", ForkerGL::GetFragmentCount());
+
+    // Sort-Last: depths & ids were merged in the packed buffer
+    if (ForkerGL::IsSortLastOn())
+    {
+        ForkerGL::ResolveVisibilityBuffer();
+        spdlog::info("  [Sort-Last] resolved the packed depth & id buffer");
+    }
+    ForkerGL::ResolveDepthClears();
+    TimeElapsed(stepStopwatch, "Visibility Pass");
+}
+
+void DoVisibilityShadingPass(const Scene& scene)
+{
+    spdlog::info("Visibility Shading Pass:");
+
+    ForkerGL::ResetFragmentCount();
+    ForkerGL::ShadeVisibilityBuffer();
+    s_VisibilityShaders.clear();
+
+    long long pixelCount = (long long)GetWidth(scene) * GetHeight(scene);
+    spdlog::info("  [Fragments] shaded: {} / {} pixels", ForkerGL::GetFragmentCount(),
+                 pixelCount);
+    TimeElapsed(stepStopwatch, "Visibility Shading Pass");
+}
+
 void DoSSAO(const Scene& scene)
 {
     spdlog::info("* Applying SSAO in deferred shading...");
@@ -230,11 +437,12 @@ void DoSSAO(const Scene& scene)
     {
         for (int x = 0; x < screenWidth; ++x)
         {
-            Point3f  positionWS = ForkerGL::WorldPosGBuffer.GetValue(x, y);
-            Vector3f normalWS = ForkerGL::NormalGBuffer.GetValue(x, y);
+            Point3f  positionWS = ForkerGL::ReadGBufferPosition(x, y);
+            Vector3f normalWS = ForkerGL::ReadGBufferNormal(x, y);
             Float    fragDepth = ForkerGL::DepthBuffer.GetValue(x, y);
 
             Float occlusion = 0.f;
+            SeedRandom(x, y);
             for (int s = 0; s < numSample; ++s)
             {
                 Vector3f sampledDirection = RandomVectorInHemisphere(normalWS);
@@ -249,8 +457,10 @@ void DoSSAO(const Scene& scene)
                 Point3f sampledPositionSS =
                     (ForkerGL::GetViewportMatrix() * sampledPositionNDC).xyz;
 
+                // Clamped to the screen (rows do not wrap in tiled depth buffers)
                 Point2i sampledScreenPosition =
-                    Point2i(sampledPositionSS.x, sampledPositionSS.y);
+                    Point2i(Clamp((int)sampledPositionSS.x, 0, screenWidth - 1),
+                            Clamp((int)sampledPositionSS.y, 0, screenHeight - 1));
                 Float sampledDepth = sampledPositionSS.z;
                 Float cachedDepth = ForkerGL::DepthBuffer.GetValue(
                     sampledScreenPosition.x, sampledScreenPosition.y);
@@ -288,6 +498,171 @@ void DoSSAO(const Scene& scene)
     ForkerGL::AmbientOcclusionGBuffer.TwoPassGaussianBlurDenoised();
 }
 
+// Edge Detection: a covered pixel is an edge if its coverage, shading type or normal
+// differs from a neighbor's, or if its depth is not on the plane through its two
+// neighbors along an axis (interpolated depths are affine in screen space)
+static const Float s_EdgeNormalThreshold = 0.8f;  // cosine
+static const Float s_EdgeDepthThreshold = 0.25f;  // relative to the depth slopes
+
+static bool IsEdgePixel(int x, int y)
+{
+    const TiledBuffer1f& depthBuffer = ForkerGL::DepthBuffer;
+    int                  width = depthBuffer.GetWidth();
+    int                  height = depthBuffer.GetHeight();
+
+    auto isCovered = [&](int px, int py) { return depthBuffer.GetValue(px, py) <= 1.f; };
+
+    bool     covered = isCovered(x, y);
+    Float    depth = depthBuffer.GetValue(x, y);
+    Vector3f normalWS = ForkerGL::ReadGBufferNormal(x, y);
+    Float    shadingType = ForkerGL::ReadGBufferShadingType(x, y);
+
+    const int offsets[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+    for (const auto& offset : offsets)
+    {
+        int nx = x + offset[0], ny = y + offset[1];
+        if (nx < 0 || ny < 0 || nx >= width || ny >= height) continue;
+
+        if (isCovered(nx, ny) != covered) return true;
+        if (!covered) continue;
+        if (ForkerGL::ReadGBufferShadingType(nx, ny) != shadingType) return true;
+        if (Dot(ForkerGL::ReadGBufferNormal(nx, ny), normalWS) <
+            s_EdgeNormalThreshold)
+            return true;
+    }
+    if (!covered) return false;
+
+    // Depth discontinuity (second difference along x and y)
+    for (int axis = 0; axis < 2; ++axis)
+    {
+        int x0 = x - (axis == 0), y0 = y - (axis == 1);
+        int x1 = x + (axis == 0), y1 = y + (axis == 1);
+        if (x0 < 0 || y0 < 0 || x1 >= width || y1 >= height) continue;
+
+        Float depth0 = depthBuffer.GetValue(x0, y0);
+        Float depth1 = depthBuffer.GetValue(x1, y1);
+        Float slopes = std::abs(depth0 - depth) + std::abs(depth1 - depth);
+        Float curvature = std::abs(depth0 + depth1 - 2.f * depth);
+        if (curvature > s_EdgeDepthThreshold * slopes + 1e-6f) return true;
+    }
+    return false;
+}
+
+// Clears the depth & G-buffers of the masked pixels for another sub-pixel sample
+static void ClearMaskedSamples(const Buffer1f& mask)
+{
+    FragmentOutput cleared;
+    cleared.shadingType = 0.f;
+    for (int y = 0; y < mask.GetHeight(); ++y)
+    {
+        for (int x = 0; x < mask.GetWidth(); ++x)
+        {
+            if (mask.GetValue(x, y) == 0.f) continue;
+            ForkerGL::DepthBuffer.SetValue(x, y, MaxFloat);
+            ForkerGL::WriteGBuffers(x, y, cleared);
+        }
+    }
+    ForkerGL::DepthHiZBuffer.Build(ForkerGL::DepthBuffer, ForkerGL::GetTileSize());
+}
+
+void DoEdgeSSAA(const Scene& scene)
+{
+    spdlog::info("Anti-Aliasing (Edge SSAA):");
+    if (!scene.IsEdgeSSAAOn())
+    {
+        spdlog::info("  [Status] Disabled");
+        return;
+    }
+    if (ForkerGL::GetRenderMode() != ForkerGL::Deferred || ForkerGL::GetSampleCount() > 1)
+    {
+        spdlog::warn("  [Status] Skipped (needs deferred rendering without MSAA)");
+        return;
+    }
+    spdlog::info("  [Status] Enabled");
+
+    int width = GetWidth(scene);
+    int height = GetHeight(scene);
+    int kernelSize = scene.GetSSAAKernelSize();
+    int numSamples = kernelSize * kernelSize;
+
+    // Edge Mask
+    Buffer1f& edgeMask = s_EdgeMask;
+    long long edgeCount = 0;
+    edgeMask.Reset(width, height, Buffer::Zero);
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            if (!IsEdgePixel(x, y)) continue;
+            edgeMask.SetValue(x, y, 1.f);
+            ++edgeCount;
+        }
+    }
+
+    Float             ratio = scene.GetRatio();
+    const Matrix4x4f& viewMatrix = scene.GetCamera().GetViewMatrix();
+    const Matrix4x4f& projectionMatrix =
+        (scene.GetProjectionType() == Camera::Orthographic)
+            ? scene.GetCamera().GetOrthographicMatrix(-1.f * ratio, 1.f * ratio, -1.f,
+                                                      1.f, s_CameraNearPlane,
+                                                      s_CameraFarPlane)
+            : scene.GetCamera().GetPerspectiveMatrix(45.f, ratio, s_CameraNearPlane,
+                                                     s_CameraFarPlane);
+
+    // Geometry & lighting passes of the edge pixels at each sub-pixel offset of a k x k
+    // grid, the viewport is shifted the opposite way. SSAO is kept per pixel.
+    Buffer3f& accumulated = s_EdgeAccumulation;
+    accumulated.Reset(width, height, Buffer::Zero);
+    ForkerGL::SetPixelMask(&edgeMask);
+    for (int j = 0; j < kernelSize; ++j)
+    {
+        for (int i = 0; i < kernelSize; ++i)
+        {
+            Float offsetX = (i + 0.5f) / kernelSize - 0.5f;
+            Float offsetY = (j + 0.5f) / kernelSize - 0.5f;
+            ForkerGL::SetViewportMatrix(-offsetX, -offsetY, width, height);
+            ClearMaskedSamples(edgeMask);
+
+            ForkerGL::SetPassType(ForkerGL::GeometryPass);
+            for (int m = 0; m < (int)scene.GetModelCount(); ++m)
+                DrawGeometryModel(scene, m, viewMatrix, projectionMatrix);
+
+            ForkerGL::SetPassType(ForkerGL::LightingPass);
+            ForkerGL::DrawScreenSpacePixels(scene);
+
+            for (int y = 0; y < height; ++y)
+            {
+                for (int x = 0; x < width; ++x)
+                {
+                    if (edgeMask.GetValue(x, y) == 0.f) continue;
+                    accumulated.SetValue(x, y, accumulated.GetValue(x, y) +
+                                                   ForkerGL::FrameBuffer.GetValue(x, y));
+                }
+            }
+        }
+    }
+    ForkerGL::SetPixelMask(nullptr);
+    ForkerGL::SetViewportMatrix(0, 0, width, height);
+
+    // Resolve
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            if (edgeMask.GetValue(x, y) == 0.f) continue;
+            ForkerGL::FrameBuffer.SetValue(x, y, accumulated.GetValue(x, y) / numSamples);
+        }
+    }
+
+    long long pixelCount = (long long)width * height;
+    spdlog::info("  [Kernel Size] {}", kernelSize);
+    spdlog::info("  [Edge Pixels] {} / {} ({:.1f}%)", edgeCount, pixelCount,
+                 100.0 * edgeCount / pixelCount);
+    spdlog::info("  [Shaded Samples] {} (uniform SSAA: {})",
+                 pixelCount + edgeCount * numSamples, pixelCount * numSamples);
+    TimeElapsed(stepStopwatch, "Anti-Aliasing (Edge)");
+}
+
 void DoSSAA(const Scene& scene)
 {
     spdlog::info("Anti-Aliasing (SSAA):");
@@ -29,10 +29,13 @@ void DoShadowPass(const Scene& scene);
 void DoForwardPass(const Scene& scene);
 void DoGeometryPass(const Scene& scene);
 void DoLightingPass(const Scene& scene);
+void DoVisibilityPass(const Scene& scene);
+void DoVisibilityShadingPass(const Scene& scene);
 
 // SSAO
 void DoSSAO(const Scene& scene);
 
 // Anti-Aliasing
+void DoEdgeSSAA(const Scene& scene);  // deferred rendering, edge pixels only
 void DoSSAA(const Scene& scene);
 }  // namespace Render
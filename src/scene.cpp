@@ -6,13 +6,16 @@
 
 #include <spdlog/spdlog.h>
 
+#include <cstdlib>
 #include <fstream>
 #include <sstream>
 
 #include "color.h"
 #include "forkergl.h"
 #include "light.h"
+#include "lightingkernel.h"
 #include "model.h"
+#include "rasterkernel.h"
 #include "shadow.h"
 #include "utility.h"
 
@@ -23,9 +26,11 @@ Scene::Scene(const std::string& filename)
     : m_Width(s_DefaultWidth),
       m_Height(s_DefaultHeight),
       m_SSAA(false),
+      m_EdgeSSAA(false),
       m_SSAO(false),
       m_SSAAKernelSize(2),
-      m_PointLight(nullptr),
+      m_DepthPrePass(false),
+      m_PointLights(),
       m_DirLight(nullptr),
       m_Camera(nullptr),
       m_Models(),
@@ -70,12 +75,18 @@ Scene::Scene(const std::string& filename)
             {
                 ForkerGL::SetRenderMode(ForkerGL::Deferred);
             }
+            else if (mode == "visibility")
+            {
+                ForkerGL::SetRenderMode(ForkerGL::Visibility);
+            }
             else  // Forward mode as default
             {
                 ForkerGL::SetRenderMode(ForkerGL::Forward);
             }
             spdlog::info("  [Mode] {}",
-                         mode == "deferred" ? "Deferred Rendering" : "Forward Rendering");
+                         mode == "deferred"     ? "Deferred Rendering"
+                         : mode == "visibility" ? "Visibility Buffer Rendering"
+                                                : "Forward Rendering");
         }
         else if (line.compare(0, 7, "screen ") == 0)  // Screen
         {
@@ -87,6 +98,7 @@ Scene::Scene(const std::string& filename)
             std::string status;
             iss >> strTrash >> status >> m_SSAAKernelSize;
             m_SSAA = (status == "on");
+            m_EdgeSSAA = (status == "edge");
         }
         else if (line.compare(0, 5, "ssao ") == 0)  // SSAO
         {
@@ -94,6 +106,72 @@ Scene::Scene(const std::string& filename)
             iss >> strTrash >> status;
             m_SSAO = (status == "on");
         }
+        else if (line.compare(0, 8, "prepass ") == 0)  // Depth Pre-Pass
+        {
+            std::string status;
+            iss >> strTrash >> status;
+            m_DepthPrePass = (status == "on");
+        }
+        else if (line.compare(0, 5, "cull ") == 0)  // Face Culling
+        {
+            // Camera passes, then shadow pass (e.g. "cull back front")
+            std::string modes[2] = { "none", "none" };
+            iss >> strTrash >> modes[0] >> modes[1];
+
+            ForkerGL::CullMode cullModes[2];
+            for (int i = 0; i < 2; ++i)
+            {
+                if (modes[i] == "back")
+                    cullModes[i] = ForkerGL::CullBack;
+                else if (modes[i] == "front")
+                    cullModes[i] = ForkerGL::CullFront;
+                else
+                    cullModes[i] = ForkerGL::CullNone;
+            }
+            ForkerGL::SetCullMode(ForkerGL::ForwardPass, cullModes[0]);
+            ForkerGL::SetCullMode(ForkerGL::DepthPrePass, cullModes[0]);
+            ForkerGL::SetCullMode(ForkerGL::GeometryPass, cullModes[0]);
+            ForkerGL::SetCullMode(ForkerGL::VisibilityPass, cullModes[0]);
+            ForkerGL::SetCullMode(ForkerGL::ShadowPass, cullModes[1]);
+            spdlog::info("  [Cull] camera: {}, shadow: {}", modes[0], modes[1]);
+        }
+        else if (line.compare(0, 8, "threads ") == 0)  // Threads
+        {
+            int count;
+            iss >> strTrash >> count;
+            ForkerGL::SetThreadCount(count);
+        }
+        else if (line.compare(0, 5, "tile ") == 0)  // Tile Size
+        {
+            int size;
+            iss >> strTrash >> size;
+            ForkerGL::SetTileSize(size);
+        }
+        else if (line.compare(0, 9, "sortlast ") == 0)  // Sort-Last Visibility Pass
+        {
+            std::string status;
+            iss >> strTrash >> status;
+            ForkerGL::SetSortLast(status == "on");
+        }
+        else if (line.compare(0, 8, "gbuffer ") == 0)  // G-Buffer Format
+        {
+            std::string format;
+            iss >> strTrash >> format;
+            ForkerGL::SetGBufferFormat(format == "packed" ? ForkerGL::Packed
+                                                          : ForkerGL::FullPrecision);
+        }
+        else if (line.compare(0, 5, "msaa ") == 0)  // MSAA (e.g. "msaa 4" or "msaa off")
+        {
+            std::string samples;
+            iss >> strTrash >> samples;
+            int count = (samples == "off") ? 1 : std::atoi(samples.c_str());
+            if (count != 1 && count != 2 && count != 4 && count != 8)
+            {
+                spdlog::warn("  [MSAA] unsupported sample count '{}', using 1", samples);
+                count = 1;
+            }
+            ForkerGL::SetSampleCount(count);
+        }
         else if (line.compare(0, 7, "shadow ") == 0)  // Shadow
         {
             std::string status;
@@ -112,12 +190,16 @@ Scene::Scene(const std::string& filename)
                 Color3 color;
                 iss >> color.x >> color.y >> color.z;
 
-                m_PointLight = std::make_unique<PointLight>(position, color);
+                Float radius = 0.f;  // optional
+                iss >> radius;
 
-                if (m_PointLight)
+                m_PointLights.emplace_back(position, color, radius);
+
+                // Logged at the end when there are many
+                if (m_PointLights.size() <= 4)
                 {
-                    spdlog::info("  [Point Light] position: {}, color: {}",
-                                 m_PointLight->position, m_PointLight->color);
+                    spdlog::info("  [Point Light] position: {}, color: {}, radius: {}",
+                                 position, color, radius);
                 }
             }
             else if (lightType == "dir")
@@ -194,6 +276,25 @@ Scene::Scene(const std::string& filename)
             m_ModelMatrices.push_back(MakeModelMatrix(position, rotateY, uniformScale));
         }
     }
-    spdlog::info("  [Config] SSAA(x{})[{}] shadow[{}] SSAO[{}]", m_SSAAKernelSize,
-                 m_SSAA ? "on" : "off", Shadow::GetShadowStatus() ? "on" : "off" , m_SSAO ? "on" : "off");
+    // The visibility buffer stores one id per pixel
+    if (ForkerGL::GetRenderMode() == ForkerGL::Visibility &&
+        ForkerGL::GetSampleCount() > 1)
+    {
+        spdlog::warn("  [MSAA] not supported by visibility buffer rendering, using 1");
+        ForkerGL::SetSampleCount(1);
+    }
+    spdlog::info("  [Config] SSAA(x{})[{}] MSAA(x{})[{}] shadow[{}] SSAO[{}] prepass[{}]",
+                 m_SSAAKernelSize, m_SSAA ? "on" : (m_EdgeSSAA ? "edge" : "off"),
+                 ForkerGL::GetSampleCount(),
+                 ForkerGL::GetSampleCount() > 1 ? "on" : "off",
+                 Shadow::GetShadowStatus() ? "on" : "off", m_SSAO ? "on" : "off",
+                 m_DepthPrePass ? "on" : "off");
+    if (m_PointLights.size() > 4)
+        spdlog::info("  [Point Lights] {} in total", m_PointLights.size());
+    spdlog::info("  [Raster] threads: {}, tile: {} x {}, kernel: {}, sort-last: {}",
+                 ForkerGL::GetThreadCount(), ForkerGL::GetTileSize(),
+                 ForkerGL::GetTileSize(), RasterKernel::GetName(),
+                 ForkerGL::IsSortLastOn() ? "on" : "off");
+    if (ForkerGL::GetRenderMode() == ForkerGL::Deferred)
+        spdlog::info("  [Lighting] kernel: {}", LightingKernel::GetName());
 }
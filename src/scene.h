@@ -10,7 +10,8 @@
 #include <string>
 #include <vector>
 
-class PointLight;
+#include "light.h"
+
 class DirLight;
 class Model;
 
@@ -24,20 +25,29 @@ public:
     int   GetHeight() const { return m_Height; }
     Float GetRatio() const { return Float(m_Width) / m_Height; }
 
-    // SSAA
+    // SSAA (uniform, or edge pixels only at the native resolution)
     bool IsSSAAOn() const { return m_SSAA; }
+    bool IsEdgeSSAAOn() const { return m_EdgeSSAA; }
     int  GetSSAAKernelSize() const { return m_SSAAKernelSize; }
 
     // SSAO
     bool IsSSAOOn() const { return m_SSAO; }
 
-    // Light
-    const PointLight& GetPointLight() const
+    // Depth Pre-Pass (forward rendering)
+    bool IsDepthPrePassOn() const { return m_DepthPrePass; }
+
+    // Light (point light 0 casts the shadows, the others are unshadowed and lit in every
+    // path, through the light clusters in forward rendering)
+    int GetPointLightCount() const { return (int)m_PointLights.size(); }
+
+    const PointLight& GetPointLight(int index = 0) const
     {
-        assert(m_PointLight != nullptr);
-        return *m_PointLight;
+        assert(index < m_PointLights.size());
+        return m_PointLights[index];
     }
 
+    const std::vector<PointLight>& GetPointLights() const { return m_PointLights; }
+
     const DirLight& GetDirLight() const
     {
         assert(m_DirLight != nullptr);
@@ -65,9 +75,11 @@ private:
     int                                 m_Width;
     int                                 m_Height;
     bool                                m_SSAA;
+    bool                                m_EdgeSSAA;
     int                                 m_SSAAKernelSize;
     bool                                m_SSAO;
-    std::unique_ptr<PointLight>         m_PointLight;
+    bool                                m_DepthPrePass;
+    std::vector<PointLight>             m_PointLights;
     std::unique_ptr<DirLight>           m_DirLight;
     std::unique_ptr<Camera>             m_Camera;
     Camera::ProjectionType              m_ProjectionType;
@@ -7,10 +7,14 @@
 #include "shader.h"
 
 // Depth Shader For Shadow Mapping
-struct DepthShader : public Shader
+struct DepthShader final : public Shader
 {
-    // Interpolation
-    Matrix3x3f vPositionNDC;
+    // Varyings (Floats per vertex)
+    enum Varying
+    {
+        PositionNDC = 0,
+        NumVaryings = 3
+    };
 
     // Transformations
     Matrix4x4f uModelMatrix;
@@ -18,20 +22,24 @@ struct DepthShader : public Shader
 
     DepthShader() : Shader() { }
 
-    Point4f ProcessVertex(int faceIdx, int vertIdx) override
+    int GetVaryingCount() const override { return NumVaryings; }
+
+    Point4f ProcessVertex(const DrawContext& context, int faceIdx, int vertIdx,
+                          Float* varyings) const override
     {
-        Point4f positionCS =
-            uLightSpaceMatrix * uModelMatrix * Point4f(mesh->Vert(faceIdx, vertIdx), 1.f);
+        Point4f positionCS = uLightSpaceMatrix * uModelMatrix *
+                             Point4f(context.mesh->Vert(faceIdx, vertIdx), 1.f);
         Point4f positionNDC = positionCS / positionCS.w;
-        vPositionNDC.SetCol(vertIdx, positionNDC.xyz);
-        return positionNDC;
+        SetVarying(varyings, PositionNDC, positionNDC.xyz);
+        return positionCS;
     }
 
-    bool ProcessFragment(const Vector3f& baryCoord, Color3& gl_Color) override
+    bool ProcessFragment(const DrawContext& /*context*/, const Float* varyings,
+                         FragmentOutput& out) const override
     {
-        // Interpolation
-        Point3f positionNDC = vPositionNDC * baryCoord;
-        gl_Color.z = positionNDC.z * 0.5f + 0.5f;  // to [0, 1]
+        // Interpolated linearly in screen space
+        Point3f positionNDC = GetVarying<3>(varyings, PositionNDC);
+        out.color.z = positionNDC.z * 0.5f + 0.5f;  // to [0, 1]
         return false;
     }
-};
\ No newline at end of file
+};
@@ -6,18 +6,19 @@
 
 #include "shader.h"
 
-struct GShader : public Shader
+struct GShader final : public Shader
 {
-    // Interpolated Variables
-    Matrix3x3f vPositionCorrectedWS;  // world space
-    Matrix2x3f vTexCoordCorrected;
-    Matrix3x3f vNormalCorrectedWS;
-    Matrix3x3f vTangentCorrectedWS;
-
-    // Vertex (out) -> Fragment (in)
-    Matrix3x3f v2fPositionsWS;
-    Matrix2x3f v2fTexCoords;
-    Vector3f   v2fOneOverWs;
+    // Varyings (Floats per vertex, premultiplied by 1/w for PCI)
+    enum Varying
+    {
+        PositionWS = 0,  // world space
+        TexCoord = 3,
+        NormalWS = 5,
+        TangentWS = 8,
+        PositionLightSpaceNDC = 11,
+        OneOverW = 14,
+        NumVaryings = 15
+    };
 
     // Uniform Variables
     Matrix4x4f uModelMatrix;
@@ -27,37 +28,32 @@ struct GShader : public Shader
 
     // For Shadow Pass
     Matrix4x4f uLightSpaceMatrix;
-    Matrix3x3f vPositionLightSpaceNDC;
-
-    // Extra Output
-    Vector3f outNormalWS;
-    Vector3f outPositionWS;
-    Vector3f outLightSpaceNDC;
-    Color3   outAlbedo;  // Diffuse
-    Color3   outEmissive;
-    Vector3f outParam;        // Specular
-    Float    outShadingType;  // PBR or Non-PBR
-
-    Point4f ProcessVertex(int faceIdx, int vertIdx) override
+
+    int GetVaryingCount() const override { return NumVaryings; }
+#ifdef PERSPECTIVE_CORRECT_INTERPOLATION
+    int GetOneOverWVarying() const override { return OneOverW; }
+#endif
+
+    // Vertex Shader
+    Point4f ProcessVertex(const DrawContext& context, int faceIdx, int vertIdx,
+                          Float* varyings) const override
     {
+        const Mesh& mesh = *context.mesh;
+
         // MVP
-        Point4f positionWS = uModelMatrix * Point4f(mesh->Vert(faceIdx, vertIdx), 1.f);
+        Point4f positionWS = uModelMatrix * Point4f(mesh.Vert(faceIdx, vertIdx), 1.f);
         Point4f positionVS = uViewMatrix * positionWS;
         Point4f positionCS = uProjectionMatrix * positionVS;
 
         // TexCoord, Normal, Tangent
-        Vector2f texCoord = mesh->TexCoord(faceIdx, vertIdx);
-        Vector3f normalWS = uNormalMatrix * mesh->Normal(faceIdx, vertIdx);
+        Vector2f texCoord = mesh.TexCoord(faceIdx, vertIdx);
+        Vector3f normalWS = uNormalMatrix * mesh.Normal(faceIdx, vertIdx);
         Vector3f tangentWS;
-        if (mesh->GetModel().HasTangents())
+        if (context.hasTangents)
         {
-            tangentWS = uNormalMatrix * mesh->Tangent(faceIdx, vertIdx);
+            tangentWS = uNormalMatrix * mesh.Tangent(faceIdx, vertIdx);
         }
 
-        // Vertex -> Fragment
-        v2fPositionsWS.SetCol(vertIdx, positionWS.xyz);
-        v2fTexCoords.SetCol(vertIdx, texCoord);
-
         // Shadow Mapping
         bool    isShadowOn = Shadow::GetShadowStatus();
         Point4f positionLightSpaceNDC;
@@ -68,62 +64,51 @@ struct GShader : public Shader
         }
 
         // PCI
+        Float oneOverW = 1.f;
 #ifdef PERSPECTIVE_CORRECT_INTERPOLATION
-        Float oneOverW = 1.f / positionCS.w;
-        v2fOneOverWs[vertIdx] = oneOverW;  // 1/w for 3 vertices
+        oneOverW = 1.f / positionCS.w;
         positionWS *= oneOverW;
         texCoord *= oneOverW;
         normalWS *= oneOverW;
-        if (mesh->GetModel().HasTangents()) tangentWS *= oneOverW;
-        if (isShadowOn) positionLightSpaceNDC *= oneOverW;
+        tangentWS *= oneOverW;
+        positionLightSpaceNDC *= oneOverW;
 #endif
-
         // Varying
-        vTexCoordCorrected.SetCol(vertIdx, texCoord);
-        vPositionCorrectedWS.SetCol(vertIdx, positionWS.xyz);
-        vNormalCorrectedWS.SetCol(vertIdx, normalWS);
-        if (mesh->GetModel().HasTangents())
-            vTangentCorrectedWS.SetCol(vertIdx, tangentWS);
-        if (isShadowOn) vPositionLightSpaceNDC.SetCol(vertIdx, positionLightSpaceNDC.xyz);
-
-        // Perspective Division
-        Point4f positionNDC = positionCS / positionCS.w;
-        return positionNDC;
+        SetVarying(varyings, PositionWS, positionWS.xyz);
+        SetVarying(varyings, TexCoord, texCoord);
+        SetVarying(varyings, NormalWS, normalWS);
+        SetVarying(varyings, TangentWS, tangentWS);
+        SetVarying(varyings, PositionLightSpaceNDC, positionLightSpaceNDC.xyz);
+        varyings[OneOverW] = oneOverW;
+
+        // Clip Space (culling, clipping and perspective division are done by ForkerGL)
+        return positionCS;
     }
+
     /////////////////////////////////////////////////////////////////////////////////
 
-    bool ProcessFragment(const Vector3f& baryCoord, Color3& gl_Color) override
+    bool ProcessFragment(const DrawContext& context, const Float* varyings,
+                         FragmentOutput& out) const override
     {
-        std::shared_ptr<const Material> material = mesh->GetMaterial();
+        const BoundMaterial& material = context.material;
 
-        // Interpolation
-        Point3f  positionWS = vPositionCorrectedWS * baryCoord;
-        Vector2f texCoord = vTexCoordCorrected * baryCoord;
-        Vector3f normalWS = vNormalCorrectedWS * baryCoord;
-
-        // PCI
-#ifdef PERSPECTIVE_CORRECT_INTERPOLATION
-        Float w = 1.f / Dot(v2fOneOverWs, baryCoord);
-        positionWS *= w;
-        texCoord *= w;
-        normalWS *= w;
-#endif
+        // Interpolated (and perspective corrected) by the rasterizer
+        Point3f  positionWS = GetVarying<3>(varyings, PositionWS);
+        Vector2f texCoord = GetVarying<2>(varyings, TexCoord);
+        Vector3f normalWS = GetVarying<3>(varyings, NormalWS);
         Vector3f N = Normalize(normalWS);  // World Space
         Vector3f normal;
 
-        if (mesh->GetModel().HasTangents() && material->HasNormalMap())
+        if (context.hasTangents && material.Has(BoundMaterial::NormalMap))
         {
-            Vector3f tangentWS = vTangentCorrectedWS * baryCoord;
-#ifdef PERSPECTIVE_CORRECT_INTERPOLATION
-            tangentWS *= w;
-#endif
+            Vector3f tangentWS = GetVarying<3>(varyings, TangentWS);
             Vector3f T = Normalize(tangentWS + Vector3f(0.001));  // avoid zero division
             // Normal (TBN Matrix)
             T = Normalize(T - Dot(T, N) * N);
             Vector3f   B = Normalize(Cross(N, T));
             Matrix3x3f TbnMatrix;
             TbnMatrix.SetCol(0, T).SetCol(1, B).SetCol(2, N);
-            Vector3f sampledNormal = material->normalMap->Sample(texCoord);
+            Vector3f sampledNormal = material.normalMap->Sample(texCoord);
             sampledNormal = Normalize(sampledNormal * 2.f - Vector3f(1.f));  // remap
             normal = Normalize(TbnMatrix * sampledNormal);  // World Space
         }
@@ -135,67 +120,69 @@ struct GShader : public Shader
         // Light Space NDC Info
         if (Shadow::GetShadowStatus())
         {
-            Point3f positionLightSpaceNDC = vPositionLightSpaceNDC * baryCoord;
-#ifdef PERSPECTIVE_CORRECT_INTERPOLATION
-            positionLightSpaceNDC *= w;
-#endif
-            outLightSpaceNDC = positionLightSpaceNDC;
+            Point3f positionLightSpaceNDC =
+                GetVarying<3>(varyings, PositionLightSpaceNDC);
+            out.lightSpaceNDC = positionLightSpaceNDC;
         }
 
         // Output Geometry Info
-        outNormalWS = normal;
-        outPositionWS = positionWS;
+        out.normalWS = normal;
+        out.positionWS = positionWS;
 
-        if (mesh->GetModel().SupportPBR())
+        if (context.supportPBR)
         {
             // PBR Material
-            std::shared_ptr<const PBRMaterial> pbrMaterial = mesh->GetPBRMaterial();
-            std::shared_ptr<const Texture>     baseColorMap = pbrMaterial->baseColorMap;
-            std::shared_ptr<const Texture>     metalnessMap = pbrMaterial->metalnessMap;
-            std::shared_ptr<const Texture>     roughnessMap = pbrMaterial->roughnessMap;
-            std::shared_ptr<const Texture>     aoMap = pbrMaterial->ambientOcclusionMap;
-            std::shared_ptr<const Texture>     emissiveMap = pbrMaterial->emissiveMap;
-
-            Color3 albedo = pbrMaterial->HasBaseColorMap()
+            const BoundMaterial& pbrMaterial = context.material;
+            const Texture*       baseColorMap = pbrMaterial.baseColorMap;
+            const Texture*       metalnessMap = pbrMaterial.metalnessMap;
+            const Texture*       roughnessMap = pbrMaterial.roughnessMap;
+            const Texture*       aoMap = pbrMaterial.ambientOcclusionMap;
+            const Texture*       emissiveMap = pbrMaterial.emissiveMap;
+
+            Color3 albedo = pbrMaterial.Has(BoundMaterial::BaseColorMap)
                                 ? baseColorMap->Sample(texCoord)
-                                : pbrMaterial->albedo;
-            Color3 emissive = pbrMaterial->HasEmssiveMap() ? emissiveMap->Sample(texCoord)
-                                                           : material->ke;
-            Float  roughness = pbrMaterial->HasRoughnessMap()
+                                : pbrMaterial.albedo;
+            Color3 emissive = pbrMaterial.Has(BoundMaterial::EmissiveMap)
+                                  ? emissiveMap->Sample(texCoord)
+                                  : pbrMaterial.ke;
+            Float  roughness = pbrMaterial.Has(BoundMaterial::RoughnessMap)
                                    ? roughnessMap->SampleFloat(texCoord)
-                                   : pbrMaterial->roughness;
-            Float  metalness = pbrMaterial->HasMetalnessMap()
+                                   : pbrMaterial.roughness;
+            Float  metalness = pbrMaterial.Has(BoundMaterial::MetalnessMap)
                                    ? metalnessMap->SampleFloat(texCoord)
-                                   : pbrMaterial->metalness;
-            Float  ao = pbrMaterial->HasAmbientOcclusionMap()
+                                   : pbrMaterial.metalness;
+            Float  ao = pbrMaterial.Has(BoundMaterial::AmbientOcclusionMap)
                             ? aoMap->SampleFloat(texCoord)
                             : 1.f;
 
-            outAlbedo = albedo;
-            outEmissive = emissive;
-            outParam = Vector3f(ao, metalness, roughness);
-            outShadingType = 1.f;  // PBR
+            out.albedo = albedo;
+            out.emissive = emissive;
+            out.param = Vector3f(ao, metalness, roughness);
+            out.shadingType = 1.f;  // PBR
         }
         else
         {
             // Material
-            std::shared_ptr<const Material> material = mesh->GetMaterial();
-            std::shared_ptr<const Texture>  diffuseMap = material->diffuseMap;
-            std::shared_ptr<const Texture>  specularMap = material->specularMap;
-            std::shared_ptr<const Texture>  emissiveMap = material->emissiveMap;
-
-            Color3 emissive =
-                material->HasEmissiveMap() ? emissiveMap->Sample(texCoord) : material->ke;
-            Color3 diffuseColor =
-                material->HasDiffuseMap() ? diffuseMap->Sample(texCoord) : material->kd;
+            const Texture* diffuseMap = material.diffuseMap;
+            const Texture* specularMap = material.specularMap;
+            const Texture* emissiveMap = material.emissiveMap;
+
+            Color3 emissive = material.Has(BoundMaterial::EmissiveMap)
+                                  ? emissiveMap->Sample(texCoord)
+                                  : material.ke;
+            Color3 diffuseColor = material.Has(BoundMaterial::DiffuseMap)
+                                      ? diffuseMap->Sample(texCoord)
+                                      : material.kd;
             Float ao = 1.f;
-            Float specular = material->ks.r;
-            Float shininess = material->HasSpecularMap() ? specularMap->SampleFloat(texCoord) + 5 : 1.f;
-
-            outAlbedo = diffuseColor;
-            outEmissive = emissive;
-            outParam = Vector3f(ao, specular, shininess);
-            outShadingType = 0.f;  // Non-PBR
+            Float specular = material.ks.r;
+            Float shininess = material.Has(BoundMaterial::SpecularMap)
+                                  ? specularMap->SampleFloat(texCoord) + 5
+                                  : 1.f;
+
+            out.albedo = diffuseColor;
+            out.emissive = emissive;
+            out.param = Vector3f(ao, specular, shininess);
+            out.shadingType = 0.f;  // Non-PBR
         }
 
         return false;  // do not discard
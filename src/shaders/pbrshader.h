@@ -6,18 +6,19 @@
 
 #include "shader.h"
 
-struct PBRShader : public Shader
+struct PBRShader final : public Shader
 {
-    // Interpolated Variables
-    Matrix3x3f vPositionCorrectedWS;  // world space
-    Matrix2x3f vTexCoordCorrected;
-    Matrix3x3f vNormalCorrectedWS;
-    Matrix3x3f vTangentCorrectedWS;
-
-    // Vertex (out) -> Fragment (in)
-    Matrix3x3f v2fPositionsWS;
-    Matrix2x3f v2fTexCoords;
-    Vector3f   v2fOneOverWs;
+    // Varyings (Floats per vertex, premultiplied by 1/w for PCI)
+    enum Varying
+    {
+        PositionWS = 0,  // world space
+        TexCoord = 3,
+        NormalWS = 5,
+        TangentWS = 8,
+        PositionLightSpaceNDC = 11,
+        OneOverW = 14,
+        NumVaryings = 15
+    };
 
     // Uniform Variables
     Matrix4x4f uModelMatrix;
@@ -27,31 +28,37 @@ struct PBRShader : public Shader
     PointLight uPointLight;
     Point3f    uEyePos;
 
+    // Other point lights (clustered forward shading, unshadowed)
+    const LightClusters* uLightClusters = nullptr;
+
     // For Shadow Pass
     Matrix4x4f uLightSpaceMatrix;
-    Matrix3x3f vPositionLightSpaceNDC;
+
+    int GetVaryingCount() const override { return NumVaryings; }
+#ifdef PERSPECTIVE_CORRECT_INTERPOLATION
+    int GetOneOverWVarying() const override { return OneOverW; }
+#endif
 
     // Vertex Shader
-    Point4f ProcessVertex(int faceIdx, int vertIdx) override
+    Point4f ProcessVertex(const DrawContext& context, int faceIdx, int vertIdx,
+                          Float* varyings) const override
     {
+        const Mesh& mesh = *context.mesh;
+
         // MVP
-        Point4f positionWS = uModelMatrix * Point4f(mesh->Vert(faceIdx, vertIdx), 1.f);
+        Point4f positionWS = uModelMatrix * Point4f(mesh.Vert(faceIdx, vertIdx), 1.f);
         Point4f positionVS = uViewMatrix * positionWS;
         Point4f positionCS = uProjectionMatrix * positionVS;
 
         // TexCoord, Normal, Tangent
-        Vector2f texCoord = mesh->TexCoord(faceIdx, vertIdx);
-        Vector3f normalWS = uNormalMatrix * mesh->Normal(faceIdx, vertIdx);
+        Vector2f texCoord = mesh.TexCoord(faceIdx, vertIdx);
+        Vector3f normalWS = uNormalMatrix * mesh.Normal(faceIdx, vertIdx);
         Vector3f tangentWS;
-        if (mesh->GetModel().HasTangents())
+        if (context.hasTangents)
         {
-            tangentWS = uNormalMatrix * mesh->Tangent(faceIdx, vertIdx);
+            tangentWS = uNormalMatrix * mesh.Tangent(faceIdx, vertIdx);
         }
 
-        // Vertex -> Fragment
-        v2fPositionsWS.SetCol(vertIdx, positionWS.xyz);
-        v2fTexCoords.SetCol(vertIdx, texCoord);
-
         // Shadow Mapping
         bool    isShadowOn = Shadow::GetShadowStatus();
         Point4f positionLightSpaceNDC;
@@ -62,64 +69,53 @@ struct PBRShader : public Shader
         }
 
         // PCI
+        Float oneOverW = 1.f;
 #ifdef PERSPECTIVE_CORRECT_INTERPOLATION
-        Float oneOverW = 1.f / positionCS.w;
-        v2fOneOverWs[vertIdx] = oneOverW;  // 1/w for 3 vertices
+        oneOverW = 1.f / positionCS.w;
         positionWS *= oneOverW;
         texCoord *= oneOverW;
         normalWS *= oneOverW;
-        if (mesh->GetModel().HasTangents()) tangentWS *= oneOverW;
-        if (isShadowOn) positionLightSpaceNDC *= oneOverW;
+        tangentWS *= oneOverW;
+        positionLightSpaceNDC *= oneOverW;
 #endif
         // Varying
-        vTexCoordCorrected.SetCol(vertIdx, texCoord);
-        vPositionCorrectedWS.SetCol(vertIdx, positionWS.xyz);
-        vNormalCorrectedWS.SetCol(vertIdx, normalWS);
-        if (mesh->GetModel().HasTangents())
-            vTangentCorrectedWS.SetCol(vertIdx, tangentWS);
-        if (isShadowOn) vPositionLightSpaceNDC.SetCol(vertIdx, positionLightSpaceNDC.xyz);
-
-        // Perspective Division
-        Point4f positionNDC = positionCS / positionCS.w;
-        return positionNDC;
+        SetVarying(varyings, PositionWS, positionWS.xyz);
+        SetVarying(varyings, TexCoord, texCoord);
+        SetVarying(varyings, NormalWS, normalWS);
+        SetVarying(varyings, TangentWS, tangentWS);
+        SetVarying(varyings, PositionLightSpaceNDC, positionLightSpaceNDC.xyz);
+        varyings[OneOverW] = oneOverW;
+
+        // Clip Space (culling, clipping and perspective division are done by ForkerGL)
+        return positionCS;
     }
 
     /////////////////////////////////////////////////////////////////////////////////
 
     // Fragment Shader
-    bool ProcessFragment(const Vector3f& baryCoord, Color3& gl_Color) override
+    bool ProcessFragment(const DrawContext& context, const Float* varyings,
+                         FragmentOutput& out) const override
     {
-        std::shared_ptr<const PBRMaterial> pbrMaterial = mesh->GetPBRMaterial();
+        const BoundMaterial& pbrMaterial = context.material;
 
-        // Interpolation
-        Point3f  positionWS = vPositionCorrectedWS * baryCoord;
-        Vector2f texCoord = vTexCoordCorrected * baryCoord;
-        Vector3f normalWS = vNormalCorrectedWS * baryCoord;
-
-        // PCI
-#ifdef PERSPECTIVE_CORRECT_INTERPOLATION
-        Float w = 1.f / Dot(v2fOneOverWs, baryCoord);
-        positionWS *= w;
-        texCoord *= w;
-        normalWS *= w;
-#endif
+        // Interpolated (and perspective corrected) by the rasterizer
+        Point3f  positionWS = GetVarying<3>(varyings, PositionWS);
+        Vector2f texCoord = GetVarying<2>(varyings, TexCoord);
+        Vector3f normalWS = GetVarying<3>(varyings, NormalWS);
 
         Vector3f N = Normalize(normalWS);  // World Space
         Vector3f normal;
 
-        if (mesh->GetModel().HasTangents() && pbrMaterial->HasNormalMap())
+        if (context.hasTangents && pbrMaterial.Has(BoundMaterial::NormalMap))
         {
-            Vector3f tangentWS = vTangentCorrectedWS * baryCoord;
-#ifdef PERSPECTIVE_CORRECT_INTERPOLATION
-            tangentWS *= w;
-#endif
+            Vector3f tangentWS = GetVarying<3>(varyings, TangentWS);
             Vector3f T = Normalize(tangentWS + Vector3f(0.001));  // avoid zero division
             // Normal (TBN Matrix)
             T = Normalize(T - Dot(T, N) * N);
             Vector3f   B = Normalize(Cross(N, T));
             Matrix3x3f TbnMatrix;
             TbnMatrix.SetCol(0, T).SetCol(1, B).SetCol(2, N);
-            Vector3f sampledNormal = pbrMaterial->normalMap->Sample(texCoord);
+            Vector3f sampledNormal = pbrMaterial.normalMap->Sample(texCoord);
             sampledNormal = Normalize(sampledNormal * 2.f - Vector3f(1.f));  // remap
             normal = Normalize(TbnMatrix * sampledNormal);
         }
@@ -130,7 +126,7 @@ struct PBRShader : public Shader
 
         // Test normal
         // normal = normal * 0.5f + Vector3f(0.5f);
-        // gl_Color = normal;
+        // out.color = normal;
         // return false;
 
         // Directions
@@ -142,54 +138,115 @@ struct PBRShader : public Shader
         Float visibility = 0.f;
         if (Shadow::GetShadowStatus())
         {
-            Point3f positionLightSpaceNDC = vPositionLightSpaceNDC * baryCoord;
-#ifdef PERSPECTIVE_CORRECT_INTERPOLATION
-            positionLightSpaceNDC *= w;
-#endif
+            Point3f positionLightSpaceNDC =
+                GetVarying<3>(varyings, PositionLightSpaceNDC);
             visibility = Shadow::CalculateShadowVisibility(
                 ForkerGL::ShadowBuffer, positionLightSpaceNDC, normal, lightDir);
         }
 
         // Physically-Based Shading
         // Texture Sampling
-        std::shared_ptr<const Texture> baseColorMap = pbrMaterial->baseColorMap;
-        std::shared_ptr<const Texture> metalnessMap = pbrMaterial->metalnessMap;
-        std::shared_ptr<const Texture> roughnessMap = pbrMaterial->roughnessMap;
-        std::shared_ptr<const Texture> aoMap = pbrMaterial->ambientOcclusionMap;
-        std::shared_ptr<const Texture> emissiveMap = pbrMaterial->emissiveMap;
-
-        Color3 albedo = pbrMaterial->HasBaseColorMap() ? baseColorMap->Sample(texCoord)
-                                                       : pbrMaterial->albedo;
-        Color3 emissive = pbrMaterial->HasEmssiveMap() ? emissiveMap->Sample(texCoord)
-                                                       : pbrMaterial->ke;
-
-        Float roughness = pbrMaterial->HasRoughnessMap()
+        const Texture* baseColorMap = pbrMaterial.baseColorMap;
+        const Texture* metalnessMap = pbrMaterial.metalnessMap;
+        const Texture* roughnessMap = pbrMaterial.roughnessMap;
+        const Texture* aoMap = pbrMaterial.ambientOcclusionMap;
+        const Texture* emissiveMap = pbrMaterial.emissiveMap;
+
+        Color3 albedo = pbrMaterial.Has(BoundMaterial::BaseColorMap)
+                            ? baseColorMap->Sample(texCoord)
+                            : pbrMaterial.albedo;
+        Color3 emissive = pbrMaterial.Has(BoundMaterial::EmissiveMap)
+                              ? emissiveMap->Sample(texCoord)
+                              : pbrMaterial.ke;
+
+        Float roughness = pbrMaterial.Has(BoundMaterial::RoughnessMap)
                               ? roughnessMap->SampleFloat(texCoord)
-                              : pbrMaterial->roughness;
-        Float metalness = pbrMaterial->HasMetalnessMap()
+                              : pbrMaterial.roughness;
+        Float metalness = pbrMaterial.Has(BoundMaterial::MetalnessMap)
                               ? metalnessMap->SampleFloat(texCoord)
-                              : pbrMaterial->metalness;
-        Float ao =
-            pbrMaterial->HasAmbientOcclusionMap() ? aoMap->SampleFloat(texCoord) : 1.f;
+                              : pbrMaterial.metalness;
+        Float ao = pbrMaterial.Has(BoundMaterial::AmbientOcclusionMap)
+                       ? aoMap->SampleFloat(texCoord)
+                       : 1.f;
         Vector3f param(ao, metalness, roughness);
 
-        gl_Color = CalculateLight(lightDir, viewDir, halfwayDir, normal, visibility,
-                                  albedo, emissive, param, uPointLight.color);
+        // Other Lights
+        Color3 otherRadiance(0.f);
+        if (uLightClusters)
+        {
+            Color3 albedoLinear = Pow(albedo, Gamma);
+            uLightClusters->ForEachLight(
+                positionWS, [&](const Vector3f& dir, const Color3& radiance) {
+                    otherRadiance +=
+                        CalculateRadiance(dir, viewDir, Normalize(dir + viewDir), normal,
+                                          albedoLinear, param, radiance);
+                });
+        }
+
+        Float distance = (uPointLight.position - positionWS).Length();
+        out.color = CalculateLight(lightDir, viewDir, halfwayDir, normal, visibility,
+                                   albedo, emissive, param,
+                                   uPointLight.color * uPointLight.Attenuation(distance),
+                                   otherRadiance);
 
         return false;  // do not discard
     }
 
+    // Shading of the shadowed point light, ambient, emissive and the linear radiance of
+    // other lights, tonemapped and gamma corrected
     static Color3 CalculateLight(const Vector3f& lightDir, const Vector3f& viewDir,
                                  const Vector3f& halfwayDir, const Vector3f& normal,
                                  Float visibility, const Color3& albedo,
                                  const Color3& emissive, const Vector3f& param,
-                                 const Color3& lightRadiance)
+                                 const Color3& lightRadiance,
+                                 const Color3& otherRadiance = Color3(0.f))
     {
         // Gamma Correction (sRGB -> Linear Space)
         Color3 albedoLinear = Pow(albedo, Gamma);
         Color3 emissiveLinear = Pow(emissive, Gamma);
 
         Float ao = param.x;
+
+        // Outgoing Radiance
+        Color3 Lo = CalculateRadiance(lightDir, viewDir, halfwayDir, normal, albedoLinear,
+                                      param, lightRadiance);
+
+        // Shadow Mapping
+        if (Shadow::GetShadowStatus())
+        {
+            Float shadowIntensity = 0.6f;
+            Float shadow = (1 - visibility) * shadowIntensity;
+            visibility = 1 - shadow;
+            Lo *= visibility;
+        }
+
+        Color3 color = Lo;
+
+        // Other Lights
+        color += otherRadiance;
+
+        // Ambient
+        Color3 ambient = Color3(0.3) * albedoLinear * ao;
+        color += ambient;
+
+        // Emissive
+        color += emissiveLinear;
+
+        // HDR Tonemapping
+        color = color / (color + Color3(1.f));
+
+        // Gamma Correction
+        color = Pow(color, InvGamma);
+
+        return Clamp01(color);
+    }
+
+    // Outgoing radiance from one light in linear space (param: ao, metalness, roughness)
+    static Color3 CalculateRadiance(const Vector3f& lightDir, const Vector3f& viewDir,
+                                    const Vector3f& halfwayDir, const Vector3f& normal,
+                                    const Color3& albedoLinear, const Vector3f& param,
+                                    const Color3& lightRadiance)
+    {
         Float metalness = param.y;
         Float roughness = param.z;
 
@@ -222,34 +279,7 @@ struct PBRShader : public Shader
         // BRDF
         Vector3f brdf = kd * albedoLinear * InvPi + specular;
 
-        // Outgoing Radiance
-        Color3 Lo = brdf * lightRadiance * NdotL;
-
-        // Shadow Mapping
-        if (Shadow::GetShadowStatus())
-        {
-            Float shadowIntensity = 0.6f;
-            Float shadow = (1 - visibility) * shadowIntensity;
-            visibility = 1 - shadow;
-            Lo *= visibility;
-        }
-
-        Color3 color = Lo;
-
-        // Ambient
-        Color3 ambient = Color3(0.3) * albedoLinear * ao;
-        color += ambient;
-
-        // Emissive
-        color += emissiveLinear;
-
-        // HDR Tonemapping
-        color = color / (color + Color3(1.f));
-
-        // Gamma Correction
-        color = Pow(color, InvGamma);
-
-        return Clamp01(color);
+        return brdf * lightRadiance * NdotL;
     }
 
 private:
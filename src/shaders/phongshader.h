@@ -6,18 +6,19 @@
 
 #include "shader.h"
 
-struct BlinnPhongShader : public Shader
+struct BlinnPhongShader final : public Shader
 {
-    // Interpolated Variables
-    Matrix3x3f vPositionCorrectedWS;  // world space
-    Matrix2x3f vTexCoordCorrected;
-    Matrix3x3f vNormalCorrectedWS;
-    Matrix3x3f vTangentCorrectedWS;
-
-    // Vertex (out) -> Fragment (in)
-    Matrix3x3f v2fPositionsWS;
-    Matrix2x3f v2fTexCoords;
-    Vector3f   v2fOneOverWs;
+    // Varyings (Floats per vertex, premultiplied by 1/w for PCI)
+    enum Varying
+    {
+        PositionWS = 0,  // world space
+        TexCoord = 3,
+        NormalWS = 5,
+        TangentWS = 8,
+        PositionLightSpaceNDC = 11,
+        OneOverW = 14,
+        NumVaryings = 15
+    };
 
     // Uniform Variables
     Matrix4x4f uModelMatrix;
@@ -27,31 +28,37 @@ struct BlinnPhongShader : public Shader
     PointLight uPointLight;
     Point3f    uEyePos;
 
+    // Other point lights (clustered forward shading, unshadowed)
+    const LightClusters* uLightClusters = nullptr;
+
     // For Shadow Pass
     Matrix4x4f uLightSpaceMatrix;
-    Matrix3x3f vPositionLightSpaceNDC;
+
+    int GetVaryingCount() const override { return NumVaryings; }
+#ifdef PERSPECTIVE_CORRECT_INTERPOLATION
+    int GetOneOverWVarying() const override { return OneOverW; }
+#endif
 
     // Vertex Shader
-    Point4f ProcessVertex(int faceIdx, int vertIdx) override
+    Point4f ProcessVertex(const DrawContext& context, int faceIdx, int vertIdx,
+                          Float* varyings) const override
     {
+        const Mesh& mesh = *context.mesh;
+
         // MVP
-        Point4f positionWS = uModelMatrix * Point4f(mesh->Vert(faceIdx, vertIdx), 1.f);
+        Point4f positionWS = uModelMatrix * Point4f(mesh.Vert(faceIdx, vertIdx), 1.f);
         Point4f positionVS = uViewMatrix * positionWS;
         Point4f positionCS = uProjectionMatrix * positionVS;
 
         // TexCoord, Normal, Tangent
-        Vector2f texCoord = mesh->TexCoord(faceIdx, vertIdx);
-        Vector3f normalWS = uNormalMatrix * mesh->Normal(faceIdx, vertIdx);
+        Vector2f texCoord = mesh.TexCoord(faceIdx, vertIdx);
+        Vector3f normalWS = uNormalMatrix * mesh.Normal(faceIdx, vertIdx);
         Vector3f tangentWS;
-        if (mesh->GetModel().HasTangents())
+        if (context.hasTangents)
         {
-            tangentWS = uNormalMatrix * mesh->Tangent(faceIdx, vertIdx);
+            tangentWS = uNormalMatrix * mesh.Tangent(faceIdx, vertIdx);
         }
 
-        // Vertex -> Fragment
-        v2fPositionsWS.SetCol(vertIdx, positionWS.xyz);
-        v2fTexCoords.SetCol(vertIdx, texCoord);
-
         // Shadow Mapping
         bool    isShadowOn = Shadow::GetShadowStatus();
         Point4f positionLightSpaceNDC;
@@ -62,63 +69,52 @@ struct BlinnPhongShader : public Shader
         }
 
         // PCI
+        Float oneOverW = 1.f;
 #ifdef PERSPECTIVE_CORRECT_INTERPOLATION
-        Float oneOverW = 1.f / positionCS.w;
-        v2fOneOverWs[vertIdx] = oneOverW;  // 1/w for 3 vertices
+        oneOverW = 1.f / positionCS.w;
         positionWS *= oneOverW;
         texCoord *= oneOverW;
         normalWS *= oneOverW;
-        if (mesh->GetModel().HasTangents()) tangentWS *= oneOverW;
-        if (isShadowOn) positionLightSpaceNDC *= oneOverW;
+        tangentWS *= oneOverW;
+        positionLightSpaceNDC *= oneOverW;
 #endif
         // Varying
-        vTexCoordCorrected.SetCol(vertIdx, texCoord);
-        vPositionCorrectedWS.SetCol(vertIdx, positionWS.xyz);
-        vNormalCorrectedWS.SetCol(vertIdx, normalWS);
-        if (mesh->GetModel().HasTangents())
-            vTangentCorrectedWS.SetCol(vertIdx, tangentWS);
-        if (isShadowOn) vPositionLightSpaceNDC.SetCol(vertIdx, positionLightSpaceNDC.xyz);
-
-        // Perspective Division
-        Point4f positionNDC = positionCS / positionCS.w;
-        return positionNDC;
+        SetVarying(varyings, PositionWS, positionWS.xyz);
+        SetVarying(varyings, TexCoord, texCoord);
+        SetVarying(varyings, NormalWS, normalWS);
+        SetVarying(varyings, TangentWS, tangentWS);
+        SetVarying(varyings, PositionLightSpaceNDC, positionLightSpaceNDC.xyz);
+        varyings[OneOverW] = oneOverW;
+
+        // Clip Space (culling, clipping and perspective division are done by ForkerGL)
+        return positionCS;
     }
 
     /////////////////////////////////////////////////////////////////////////////////
 
     // Fragment Shader
-    bool ProcessFragment(const Vector3f& baryCoord, Color3& gl_Color) override
+    bool ProcessFragment(const DrawContext& context, const Float* varyings,
+                         FragmentOutput& out) const override
     {
-        std::shared_ptr<const Material> material = mesh->GetMaterial();
-
-        // Interpolation
-        Point3f  positionWS = vPositionCorrectedWS * baryCoord;
-        Vector2f texCoord = vTexCoordCorrected * baryCoord;
-        Vector3f normalWS = vNormalCorrectedWS * baryCoord;
+        const BoundMaterial& material = context.material;
 
-        // PCI
-#ifdef PERSPECTIVE_CORRECT_INTERPOLATION
-        Float w = 1.f / Dot(v2fOneOverWs, baryCoord);
-        positionWS *= w;
-        texCoord *= w;
-        normalWS *= w;
-#endif
+        // Interpolated (and perspective corrected) by the rasterizer
+        Point3f  positionWS = GetVarying<3>(varyings, PositionWS);
+        Vector2f texCoord = GetVarying<2>(varyings, TexCoord);
+        Vector3f normalWS = GetVarying<3>(varyings, NormalWS);
         Vector3f N = Normalize(normalWS);  // World Space
         Vector3f normal;
 
-        if (mesh->GetModel().HasTangents() && material->HasNormalMap())
+        if (context.hasTangents && material.Has(BoundMaterial::NormalMap))
         {
-            Vector3f tangentWS = vTangentCorrectedWS * baryCoord;
-#ifdef PERSPECTIVE_CORRECT_INTERPOLATION
-            tangentWS *= w;
-#endif
+            Vector3f tangentWS = GetVarying<3>(varyings, TangentWS);
             Vector3f T = Normalize(tangentWS + Vector3f(0.001));  // avoid zero division
             // Normal (TBN Matrix)
             T = Normalize(T - Dot(T, N) * N);
             Vector3f   B = Normalize(Cross(N, T));
             Matrix3x3f TbnMatrix;
             TbnMatrix.SetCol(0, T).SetCol(1, B).SetCol(2, N);
-            Vector3f sampledNormal = material->normalMap->Sample(texCoord);
+            Vector3f sampledNormal = material.normalMap->Sample(texCoord);
             sampledNormal = Normalize(sampledNormal * 2.f - Vector3f(1.f));  // remap
             normal = Normalize(TbnMatrix * sampledNormal);  // World Space
         }
@@ -128,7 +124,7 @@ struct BlinnPhongShader : public Shader
         }
 
         // normal = normal * 0.5f + Vector3f(0.5f);
-        // gl_Color = normal;
+        // out.color = normal;
         // return false;
 
         // Directions
@@ -140,38 +136,57 @@ struct BlinnPhongShader : public Shader
         Float visibility = 0.f;
         if (Shadow::GetShadowStatus())
         {
-            Point3f positionLightSpaceNDC = vPositionLightSpaceNDC * baryCoord;
-#ifdef PERSPECTIVE_CORRECT_INTERPOLATION
-            positionLightSpaceNDC *= w;
-#endif
+            Point3f positionLightSpaceNDC =
+                GetVarying<3>(varyings, PositionLightSpaceNDC);
             visibility = Shadow::CalculateShadowVisibility(
                 ForkerGL::ShadowBuffer, positionLightSpaceNDC, normal, lightDir);
         }
 
         // Blinn-Phong Shading
-        std::shared_ptr<const Texture> diffuseMap = material->diffuseMap;
-        std::shared_ptr<const Texture> specularMap = material->specularMap;
-        std::shared_ptr<const Texture> emissiveMap = material->emissiveMap;
-
-        Color3 diffuseColor =
-            material->HasDiffuseMap() ? diffuseMap->Sample(texCoord) : material->kd;
-        Color3 emissive =
-            material->HasEmissiveMap() ? emissiveMap->Sample(texCoord) : material->ke;
+        const Texture* diffuseMap = material.diffuseMap;
+        const Texture* specularMap = material.specularMap;
+        const Texture* emissiveMap = material.emissiveMap;
+
+        Color3 diffuseColor = material.Has(BoundMaterial::DiffuseMap)
+                                  ? diffuseMap->Sample(texCoord)
+                                  : material.kd;
+        Color3 emissive = material.Has(BoundMaterial::EmissiveMap)
+                              ? emissiveMap->Sample(texCoord)
+                              : material.ke;
         Float shininess = 1.f;
-        if (material->HasSpecularMap())
+        if (material.Has(BoundMaterial::SpecularMap))
             shininess = specularMap->SampleFloat(texCoord) + 5;
-        Vector3f param(material->ka.x, material->ks.x, shininess);
+        Vector3f param(material.ka.x, material.ks.x, shininess);
 
-        gl_Color = CalculateLight(lightDir, halfwayDir, normal, visibility, diffuseColor,
-                                  emissive, param, uPointLight.color);
+        // Other Lights
+        Color3 otherRadiance(0.f);
+        if (uLightClusters)
+        {
+            Color3 diffuseColorLinear = Pow(diffuseColor, Gamma);
+            uLightClusters->ForEachLight(
+                positionWS, [&](const Vector3f& dir, const Color3& radiance) {
+                    otherRadiance +=
+                        CalculateRadiance(dir, Normalize(dir + viewDir), normal,
+                                          diffuseColorLinear, param, radiance);
+                });
+        }
+
+        Float distance = (uPointLight.position - positionWS).Length();
+        out.color = CalculateLight(lightDir, halfwayDir, normal, visibility, diffuseColor,
+                                   emissive, param,
+                                   uPointLight.color * uPointLight.Attenuation(distance),
+                                   otherRadiance);
 
         return false;  // do not discard
     }
 
+    // Shading of the shadowed point light, ambient, emissive and the linear radiance of
+    // other lights, tonemapped and gamma corrected
     static Color3 CalculateLight(const Vector3f& lightDir, const Vector3f& halfwayDir,
                                  const Vector3f& normal, Float visibility,
                                  const Color3& diffuseColor, const Color3& emissive,
-                                 const Vector3f& param, const Color3& lightColor)
+                                 const Vector3f& param, const Color3& lightColor,
+                                 const Color3& otherRadiance = Color3(0.f))
     {
         // Gamma Correction (sRGB -> Linear Space)
         Color3 diffuseColorLinear = Pow(diffuseColor, Gamma);
@@ -204,6 +219,7 @@ struct BlinnPhongShader : public Shader
 
         // Combine
         Color3 color = ambient + (diffuse + specular + emissiveLinear) * lightColor;
+        color += otherRadiance;
 
         // HDR Tonemapping
         color = color / (color + Color3(1.f));
@@ -213,4 +229,17 @@ struct BlinnPhongShader : public Shader
 
         return Clamp01(color);
     }
+
+    // Outgoing radiance from one light in linear space (param: ao, ks, shininess)
+    static Color3 CalculateRadiance(const Vector3f& lightDir, const Vector3f& halfwayDir,
+                                    const Vector3f& normal,
+                                    const Color3& diffuseColorLinear,
+                                    const Vector3f& param, const Color3& lightColor)
+    {
+        Float diff = Max(0.f, Dot(lightDir, normal));
+        Float spec = std::pow(Max(0.f, Dot(halfwayDir, normal)), param.z);
+        Color3 diffuse = diffuseColorLinear * diff * param.x;
+        Color3 specular = Color3(param.y) * spec;
+        return (diffuse + specular) * lightColor;
+    }
 };
\ No newline at end of file
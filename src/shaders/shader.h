@@ -11,24 +11,78 @@
 #include "color.h"
 #include "geometry.h"
 #include "light.h"
+#include "lightcluster.h"
 #include "mesh.h"
 #include "model.h"
 #include "tgaimage.h"
 #include "shadow.h"
 #include "forkergl.h"
 
-// Abstract Class
+// Per-Draw State of a mesh (shared by every triangle of the draw)
+struct DrawContext
+{
+    const Mesh*   mesh;
+    BoundMaterial material;
+    bool          hasTangents;
+    bool          supportPBR;
+    int           drawId;  // draw record of the visibility pass (-1 in other passes)
+};
+
+// Varyings of the three vertices of a triangle, as written by the vertex shader
+struct TriangleVaryings
+{
+    const Float* vertices[3];
+};
+
+// Fragment Shader Outputs (color, or the G-buffer attributes in the geometry pass)
+struct FragmentOutput
+{
+    Color3   color;
+    Vector3f normalWS;
+    Vector3f positionWS;
+    Vector3f lightSpaceNDC;
+    Color3   albedo;  // Diffuse
+    Color3   emissive;
+    Vector3f param;        // Specular
+    Float    shadingType;  // PBR or Non-PBR
+};
+
+// Abstract Class: shaders only hold uniforms, which are set before drawing and are
+// read-only afterwards, so one instance is shared by all raster workers
 struct Shader
 {
-    std::shared_ptr<const Mesh> mesh;
+    static const int MaxVaryings = 32;
 
-    Shader() : mesh(nullptr) { }
+    Shader() = default;
     virtual ~Shader() { }
 
-    // Use Shader Program (set which mesh to shade on)
-    void Use(std::shared_ptr<const Mesh> m) { mesh = m; }
-    // Vertex Shader
-    virtual Point4f ProcessVertex(int faceIdx, int vertIdx) = 0;
-    // Fragment Shader
-    virtual bool ProcessFragment(const Vector3f& baryCoord, Color3& gl_Color) = 0;
+    // Number of Floats written to the varyings of a vertex (at most MaxVaryings)
+    virtual int GetVaryingCount() const = 0;
+    // Varying holding 1/w, which the rasterizer divides all varyings by (PCI), or -1 to
+    // interpolate them linearly in screen space
+    virtual int GetOneOverWVarying() const { return -1; }
+    // Vertex Shader (returns the clip-space position)
+    virtual Point4f ProcessVertex(const DrawContext& context, int faceIdx, int vertIdx,
+                                  Float* varyings) const = 0;
+    // Fragment Shader (varyings are interpolated at the pixel, returns true to discard)
+    virtual bool ProcessFragment(const DrawContext& context, const Float* varyings,
+                                 FragmentOutput& out) const = 0;
+
+    // Write a vector into the varyings of a vertex
+    template <size_t DIM>
+    static void SetVarying(Float* varyings, int offset, const Vector<DIM, Float>& v)
+    {
+        for (size_t i = 0; i < DIM; ++i)
+            varyings[offset + i] = v[i];
+    }
+
+    // Read a vector from the varyings of a vertex or a fragment
+    template <size_t DIM>
+    static Vector<DIM, Float> GetVarying(const Float* varyings, int offset)
+    {
+        Vector<DIM, Float> v;
+        for (size_t i = 0; i < DIM; ++i)
+            v[i] = varyings[offset + i];
+        return v;
+    }
 };
@@ -4,10 +4,9 @@
 
 #pragma once
 
+#include "buffer.h"
 #include "geometry.h"
 
-class Buffer1f;
-
 // Enable Perspective Correct Mapping (PCI)
 #define PERSPECTIVE_CORRECT_INTERPOLATION
 
@@ -27,20 +26,20 @@ namespace Shadow
 void SetShadowStatus(bool status);
 bool GetShadowStatus();
 
-Float SampleShadowMap(const Buffer1f& shadowMap, const Vector2f& uv);
+Float SampleShadowMap(const BufferD24& shadowMap, const Vector2f& uv);
 
-Float HardShadow(const Buffer1f& shadowMap, const Vector3f& shadowCoord, Float bias);
+Float HardShadow(const BufferD24& shadowMap, const Vector3f& shadowCoord, Float bias);
 
 // PCF
-Float PCF(const Buffer1f& shadowMap, const Vector3f& shadowCoord, Float bias,
+Float PCF(const BufferD24& shadowMap, const Vector3f& shadowCoord, Float bias,
           Float filterSize);
 
 // PCSS
-Float FindAverageBlockDepth(const Buffer1f& shadowMap, const Vector3f& shadowCoord,
+Float FindAverageBlockDepth(const BufferD24& shadowMap, const Vector3f& shadowCoord,
                             Float bias);
-Float PCSS(const Buffer1f& shadowMap, const Vector3f& shadowCoord, Float bias);
+Float PCSS(const BufferD24& shadowMap, const Vector3f& shadowCoord, Float bias);
 
-Float CalculateShadowVisibility(const Buffer1f&   shadowMap,
+Float CalculateShadowVisibility(const BufferD24& shadowMap,
                                 const Vector3f& positionLightSpaceNDC,
                                 const Vector3f& normal, const Vector3f& lightDir);
 }  // namespace Shadow
\ No newline at end of file
@@ -0,0 +1,102 @@
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(int numThreads)
+    : m_Job(nullptr),
+      m_JobCount(0),
+      m_NextIndex(0),
+      m_NumActiveWorkers(0),
+      m_Generation(0),
+      m_Stop(false)
+{
+    for (int i = 1; i < numThreads; ++i)  // the calling thread is the first one
+    {
+        m_Workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Stop = true;
+    }
+    m_WorkCondition.notify_all();
+
+    for (std::thread& worker : m_Workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::ParallelFor(int count, const std::function<void(int)>& job)
+{
+    if (count <= 0) return;
+
+    // Not worth waking up the workers
+    if (count == 1 || m_Workers.empty())
+    {
+        for (int i = 0; i < count; ++i)
+            job(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Job = &job;
+        m_JobCount = count;
+        m_NextIndex = 0;
+        m_NumActiveWorkers = (int)m_Workers.size();
+        ++m_Generation;
+    }
+    m_WorkCondition.notify_all();
+
+    // Calling thread works as well
+    runJobs(job, count);
+
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_DoneCondition.wait(lock, [this] { return m_NumActiveWorkers == 0; });
+    m_Job = nullptr;
+}
+
+int ThreadPool::GetHardwareThreadCount()
+{
+    unsigned int count = std::thread::hardware_concurrency();
+    return count == 0 ? 1 : (int)count;
+}
+
+void ThreadPool::workerLoop()
+{
+    uint64_t generation = 0;
+    while (true)
+    {
+        const std::function<void(int)>* job;
+        int                             count;
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_WorkCondition.wait(lock,
+                                 [&] { return m_Stop || m_Generation != generation; });
+            if (m_Stop) return;
+
+            generation = m_Generation;
+            job = m_Job;
+            count = m_JobCount;
+        }
+
+        runJobs(*job, count);
+
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            --m_NumActiveWorkers;
+        }
+        m_DoneCondition.notify_one();
+    }
+}
+
+void ThreadPool::runJobs(const std::function<void(int)>& job, int count)
+{
+    // Jobs are handed out one by one so uneven jobs (e.g. tiles) balance themselves
+    for (int i = m_NextIndex.fetch_add(1); i < count; i = m_NextIndex.fetch_add(1))
+    {
+        job(i);
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent Worker Pool (threads are created once and reused by every pass)
+class ThreadPool
+{
+public:
+    // numThreads includes the calling thread, which also takes jobs in ParallelFor()
+    explicit ThreadPool(int numThreads);
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool();
+
+    int GetThreadCount() const { return (int)m_Workers.size() + 1; }
+
+    // Runs job(0) ... job(count - 1) and returns when all of them are finished
+    void ParallelFor(int count, const std::function<void(int)>& job);
+
+    static int GetHardwareThreadCount();
+
+private:
+    std::vector<std::thread> m_Workers;
+    std::mutex               m_Mutex;
+    std::condition_variable  m_WorkCondition;
+    std::condition_variable  m_DoneCondition;
+
+    // Current job (guarded by m_Mutex except m_NextIndex)
+    const std::function<void(int)>* m_Job;
+    int                             m_JobCount;
+    std::atomic<int>                m_NextIndex;
+    int                             m_NumActiveWorkers;
+    uint64_t                        m_Generation;
+    bool                            m_Stop;
+
+    void workerLoop();
+    void runJobs(const std::function<void(int)>& job, int count);
+};
@@ -6,8 +6,8 @@
 
 #include <spdlog/stopwatch.h>
 
+#include <cstdint>
 #include <cstdlib>
-#include <random>
 
 #include "constant.h"
 
@@ -90,14 +90,37 @@ inline Float Pow(Float val, Float pval)
     return std::pow(val, pval);
 }
 
+// PCG hash, a cheap 32-bit integer mix
+inline uint32_t HashUInt32(uint32_t value)
+{
+    uint32_t state = value * 747796405u + 2891336453u;
+    uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// Random numbers are hashed from a counter of the calling thread. Pixels are shaded in
+// parallel, so the counter is reseeded per pixel and the noise of a pixel does not
+// depend on which thread shades it.
+inline uint32_t& RandomCounter()
+{
+    static thread_local uint32_t counter = 0u;
+    return counter;
+}
+
+inline void SeedRandom(int x, int y, int sample = 0)
+{
+    RandomCounter() =
+        HashUInt32((uint32_t)x + HashUInt32((uint32_t)y + HashUInt32((uint32_t)sample)));
+}
+
 inline Float Random01()
 {
     // Old
     // return rand() / (RAND_MAX + 1.f);
-    // New
-    static std::uniform_real_distribution<Float> distribution(0.f, 1.f);
-    static std::mt19937                          generator;
-    return distribution(generator);
+    // New (24 bits of a hashed counter, see SeedRandom())
+    uint32_t& counter = RandomCounter();
+    counter += 0x9E3779B9u;
+    return (Float)(HashUInt32(counter) >> 8) * (1.f / 16777216.f);
 }
 
 inline Float Random(Float min, Float max)